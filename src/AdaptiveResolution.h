@@ -0,0 +1,198 @@
+#pragma once
+
+#include <inttypes.h>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "FrameArena.h"
+#include "FrameBuffer.h"
+#include "Profiler.h"
+#include "Texture.h"
+#include "ThreadPool.h"
+
+// The coarsest internal resolution is the output divided by this on each side.
+#define MAX_RESOLUTION_SCALE 4
+
+// How much each new frame time moves the running estimate of the cost per pixel.
+#define FRAME_COST_SMOOTHING 0.25f
+
+/**
+ * Chooses the internal resolution of each frame so the renderer keeps to a
+ * frame time budget while the camera moves, then refines to full resolution
+ * once it stops.
+ *
+ * A frame is rendered at 1/scale of the output's width and height and
+ * scaled up. While the camera moves, the scale is the smallest whose
+ * predicted time fits the budget, predicted from the smoothed cost per
+ * pixel of recent frames. Once the camera is still the scale halves each
+ * frame down to 1, and after that nothing is drawn until something changes.
+ */
+class AdaptiveResolution
+{
+private:
+  int width, height;
+  float budget;
+  float costPerPixel;
+  bool enabled;
+  bool dirty;
+  bool settled;
+  int scale;
+  glm::mat4x4 lastCamera;
+  float lastFocalLength;
+
+  bool cameraMoved(const glm::mat4x4& cameraToWorld, float focalLength) const
+  {
+    if (focalLength != lastFocalLength) return true;
+    for (int i = 0; i < 4; ++i)
+    {
+      for (int j = 0; j < 4; ++j)
+      {
+        if (cameraToWorld[i][j] != lastCamera[i][j]) return true;
+      }
+    }
+    return false;
+  }
+
+public:
+  /**
+   * @param width The width of the output.
+   * @param height The height of the output.
+   * @param budget The time a frame should take while the camera moves, in milliseconds.
+   */
+  AdaptiveResolution(int width, int height, float budget)
+  : width(width)
+  , height(height)
+  , budget(budget)
+  , costPerPixel(0.0f)
+  , enabled(false)
+  , dirty(true)
+  , settled(false)
+  , scale(1)
+  , lastCamera(1.0f)
+  , lastFocalLength(0.0f)
+  {}
+
+  /**
+   * Turns adaptive resolution on or off. While it is off, every frame is drawn at full resolution.
+   */
+  void setEnabled(bool on)
+  {
+    enabled = on;
+    dirty = true;
+  }
+
+  bool isEnabled() const
+  {
+    return enabled;
+  }
+
+  /**
+   * Marks the frame on screen as out of date for reasons other than the
+   * camera, such as a change to how the scene is drawn.
+   */
+  void invalidate()
+  {
+    dirty = true;
+  }
+
+  /**
+   * Decides how the next frame is to be drawn.
+   *
+   * @param cameraToWorld The camera the frame is drawn from.
+   * @param focalLength The focal length of the camera.
+   * @return The scale to divide the output size by, or 0 if the frame on screen is already final.
+   */
+  int begin(const glm::mat4x4& cameraToWorld, float focalLength)
+  {
+    bool moved = dirty || cameraMoved(cameraToWorld, focalLength);
+    lastCamera = cameraToWorld;
+    lastFocalLength = focalLength;
+    dirty = false;
+
+    if (!enabled)
+    {
+      scale = 1;
+      return scale;
+    }
+
+    if (moved)
+    {
+      float pixels = (float) width * height;
+      scale = 1;
+      while (scale < MAX_RESOLUTION_SCALE && costPerPixel * pixels / (scale * scale) > budget) ++scale;
+      settled = scale == 1;
+      return scale;
+    }
+
+    if (settled) return 0;
+    scale = std::max(1, scale / 2);
+    settled = scale == 1;
+    return scale;
+  }
+
+  /**
+   * Records how long the frame begun last took.
+   *
+   * @param milliseconds The time spent drawing it.
+   */
+  void end(float milliseconds)
+  {
+    int pixels = ((width + scale - 1) / scale) * ((height + scale - 1) / scale);
+    float cost = milliseconds / pixels;
+    costPerPixel = costPerPixel > 0 ? costPerPixel + (cost - costPerPixel) * FRAME_COST_SMOOTHING : cost;
+  }
+};
+
+/**
+ * Scales a frame up to a larger one, filtering colour bilinearly and
+ * taking the nearest depth, in parallel across bands of rows.
+ *
+ * @param from The frame to scale up.
+ * @param to The frame to scale it into. Its depth blocks are reset.
+ * @param pool The thread pool the rows are spread across.
+ * @param arena The arena the table of source columns is allocated from.
+ */
+void upscale(const FrameBuffer& from, FrameBuffer& to, ThreadPool& pool, FrameArena& arena)
+{
+  PROFILE_SCOPE(STAGE_UPSCALE);
+
+  // Each output pixel centre maps to a point in the smaller frame, in 1/256ths of a pixel.
+  int* columns = arena.allocate<int>(to.width);
+  float stepX = (float) from.width / to.width;
+  float stepY = (float) from.height / to.height;
+  for (int x = 0; x < to.width; ++x)
+  {
+    float fx = std::min(std::max((x + 0.5f) * stepX - 0.5f, 0.0f), from.width - 1.0f);
+    columns[x] = (int) (fx * 256.0f);
+  }
+
+  const int bandHeight = 16;
+  int bands = (to.height + bandHeight - 1) / bandHeight;
+  pool.parallelFor(bands, [&](int band)
+  {
+    int y1 = std::min((band + 1) * bandHeight, to.height);
+    for (int y = band * bandHeight; y < y1; ++y)
+    {
+      float fy = std::min(std::max((y + 0.5f) * stepY - 0.5f, 0.0f), from.height - 1.0f);
+      int row = (int) (fy * 256.0f);
+      int top = row >> 8, bottom = std::min(top + 1, from.height - 1);
+      uint32_t weightY = row & 255;
+      const uint32_t* upper = from.pixels + top * from.width;
+      const uint32_t* lower = from.pixels + bottom * from.width;
+      const float* nearest = from.depth + (weightY < 128 ? top : bottom) * from.width;
+
+      uint32_t* pixels = to.pixels + y * to.width;
+      float* depth = to.depth + y * to.width;
+      for (int x = 0; x < to.width; ++x)
+      {
+        int left = columns[x] >> 8, right = std::min(left + 1, from.width - 1);
+        uint32_t weightX = columns[x] & 255;
+        uint32_t colour = lerpColour(lerpColour(upper[left], upper[right], weightX), lerpColour(lower[left], lower[right], weightX), weightY);
+        pixels[x] = colour;
+        depth[x] = nearest[weightX < 128 ? left : right];
+      }
+    }
+  });
+
+  to.forgetBlocks();
+  to.markDirty();
+}
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <algorithm>
+#include <inttypes.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Bounds.h"
+#include "Mesh.h"
+
+// The most triangles a leaf holds before it is split.
+#define BVH_LEAF_SIZE 16
+
+/**
+ * A half-open range of indices.
+ */
+struct IndexRange
+{
+    uint32_t begin, end;
+};
+
+/**
+ * A node of a bounding volume hierarchy. Every node, not just leaves,
+ * covers a contiguous run of the hierarchy's triangle list, so a subtree
+ * that is wholly visible can be drawn without visiting its children.
+ */
+struct BVHNode
+{
+    AABB bounds;
+    uint32_t firstTriangle, triangleCount;
+
+    // The first of two adjacent children, or 0 for a leaf.
+    uint32_t left;
+
+    // The vertices the subtree's triangles use all lie in this range.
+    IndexRange vertices;
+};
+
+/**
+ * A bounding volume hierarchy over a mesh. The upper levels split between
+ * whole objects and the lower levels split each object's triangles, both
+ * at the median centroid along the longest axis.
+ */
+struct BVH
+{
+    std::vector<BVHNode> nodes;
+
+    // Triangle indices, ordered so each node covers a contiguous run.
+    std::vector<uint32_t> triangles;
+};
+
+/**
+ * Builds a BVH node by node. Objects are laid out in the triangle list as
+ * they are reached, so every subtree's triangles end up contiguous.
+ */
+struct BVHBuilder
+{
+    struct Group
+    {
+        IndexRange triangles;
+        AABB bounds;
+    };
+
+    const MeshView& mesh;
+    BVH& bvh;
+    std::vector<AABB> triangleBounds;
+    std::vector<Group> groups;
+    uint32_t nextTriangle;
+
+    BVHBuilder(const MeshView& mesh, BVH& bvh)
+    : mesh(mesh)
+    , bvh(bvh)
+    , nextTriangle(0)
+    {}
+
+    AABB boundsOf(uint32_t triangle) const
+    {
+        AABB box;
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            uint32_t v = mesh.indices[3 * triangle + corner];
+            box.grow(glm::vec3(mesh.x[v], mesh.y[v], mesh.z[v]));
+        }
+        return box;
+    }
+
+    static int longestAxis(const AABB& box)
+    {
+        glm::vec3 extent = box.extent();
+        if (extent.x >= extent.y && extent.x >= extent.z) return 0;
+        return extent.y >= extent.z ? 1 : 2;
+    }
+
+    void splitNode(uint32_t node)
+    {
+        uint32_t left = bvh.nodes.size();
+        bvh.nodes[node].left = left;
+        bvh.nodes.push_back(BVHNode());
+        bvh.nodes.push_back(BVHNode());
+    }
+
+    void finishNode(uint32_t node)
+    {
+        BVHNode& n = bvh.nodes[node];
+        const BVHNode& a = bvh.nodes[n.left];
+        const BVHNode& b = bvh.nodes[n.left + 1];
+        n.bounds = a.bounds;
+        n.bounds.grow(b.bounds);
+        n.firstTriangle = a.firstTriangle;
+        n.triangleCount = a.triangleCount + b.triangleCount;
+        n.vertices.begin = std::min(a.vertices.begin, b.vertices.begin);
+        n.vertices.end = std::max(a.vertices.end, b.vertices.end);
+    }
+
+    void buildTriangles(uint32_t node, uint32_t first, uint32_t count)
+    {
+        if (count <= BVH_LEAF_SIZE)
+        {
+            BVHNode& leaf = bvh.nodes[node];
+            leaf.firstTriangle = first;
+            leaf.triangleCount = count;
+            leaf.left = 0;
+            leaf.bounds = AABB();
+            leaf.vertices.begin = UINT32_MAX;
+            leaf.vertices.end = 0;
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                uint32_t triangle = bvh.triangles[i];
+                leaf.bounds.grow(triangleBounds[triangle]);
+                for (int corner = 0; corner < 3; ++corner)
+                {
+                    uint32_t v = mesh.indices[3 * triangle + corner];
+                    leaf.vertices.begin = std::min(leaf.vertices.begin, v);
+                    leaf.vertices.end = std::max(leaf.vertices.end, v + 1);
+                }
+            }
+            return;
+        }
+
+        AABB centres;
+        for (uint32_t i = first; i < first + count; ++i) centres.grow(triangleBounds[bvh.triangles[i]].centre());
+        int axis = longestAxis(centres);
+
+        uint32_t* begin = bvh.triangles.data() + first;
+        std::nth_element(begin, begin + count / 2, begin + count, [&](uint32_t a, uint32_t b)
+        {
+            return triangleBounds[a].centre()[axis] < triangleBounds[b].centre()[axis];
+        });
+
+        splitNode(node);
+        uint32_t left = bvh.nodes[node].left;
+        buildTriangles(left, first, count / 2);
+        buildTriangles(left + 1, first + count / 2, count - count / 2);
+        finishNode(node);
+    }
+
+    void buildGroups(uint32_t node, uint32_t first, uint32_t count)
+    {
+        if (count == 1)
+        {
+            const Group& group = groups[first];
+            uint32_t start = nextTriangle;
+            for (uint32_t t = group.triangles.begin; t < group.triangles.end; ++t) bvh.triangles[nextTriangle++] = t;
+            buildTriangles(node, start, nextTriangle - start);
+            return;
+        }
+
+        AABB centres;
+        for (uint32_t i = first; i < first + count; ++i) centres.grow(groups[i].bounds.centre());
+        int axis = longestAxis(centres);
+
+        Group* begin = groups.data() + first;
+        std::nth_element(begin, begin + count / 2, begin + count, [&](const Group& a, const Group& b)
+        {
+            return a.bounds.centre()[axis] < b.bounds.centre()[axis];
+        });
+
+        splitNode(node);
+        uint32_t left = bvh.nodes[node].left;
+        buildGroups(left, first, count / 2);
+        buildGroups(left + 1, first + count / 2, count - count / 2);
+        finishNode(node);
+    }
+};
+
+/**
+ * Builds a BVH over the objects and triangles of a mesh.
+ *
+ * @param mesh The mesh, which the BVH refers to by triangle and vertex index.
+ * @return The hierarchy. It has no nodes if the mesh has no triangles.
+ */
+BVH buildBVH(const MeshView& mesh)
+{
+    BVH bvh;
+    if (mesh.triangleCount == 0) return bvh;
+
+    BVHBuilder builder(mesh, bvh);
+    builder.triangleBounds.resize(mesh.triangleCount);
+    for (int i = 0; i < mesh.triangleCount; ++i) builder.triangleBounds[i] = builder.boundsOf(i);
+
+    // Each object is a group, as are any triangles before the first object.
+    uint32_t start = 0;
+    for (int i = 0; i <= mesh.objectCount; ++i)
+    {
+        uint32_t end = i < mesh.objectCount ? mesh.objectStarts[i] : mesh.triangleCount;
+        if (end > start)
+        {
+            BVHBuilder::Group group;
+            group.triangles.begin = start;
+            group.triangles.end = end;
+            for (uint32_t t = start; t < end; ++t) group.bounds.grow(builder.triangleBounds[t]);
+            builder.groups.push_back(group);
+        }
+        start = std::max(start, end);
+    }
+
+    bvh.triangles.resize(mesh.triangleCount);
+    bvh.nodes.reserve(2 * (mesh.triangleCount / (BVH_LEAF_SIZE / 2) + builder.groups.size()));
+    bvh.nodes.push_back(BVHNode());
+    builder.buildGroups(0, 0, builder.groups.size());
+    return bvh;
+}
+
+/**
+ * Finds the parts of a BVH inside a frustum. Subtrees wholly outside are
+ * skipped without visiting their children, and subtrees wholly inside are
+ * kept without testing them any further.
+ *
+ * @param bvh The hierarchy.
+ * @param frustum The frustum.
+ * @param visible Receives the nodes whose triangles are to be drawn. Its storage is reused.
+ */
+void cullBVH(const BVH& bvh, const Frustum& frustum, std::vector<uint32_t>& visible)
+{
+    visible.clear();
+    if (bvh.nodes.empty()) return;
+
+    // Median splits keep the tree shallow, far below the stack size.
+    uint32_t stack[64];
+    int masks[64];
+    int size = 0;
+    stack[size] = 0;
+    masks[size++] = FRUSTUM_ALL_PLANES;
+
+    while (size > 0)
+    {
+        --size;
+        uint32_t index = stack[size];
+        const BVHNode& node = bvh.nodes[index];
+        int mask = cullBox(frustum, node.bounds, masks[size]);
+        if (mask < 0) continue;
+
+        if (mask == 0 || node.left == 0)
+        {
+            visible.push_back(index);
+            continue;
+        }
+
+        stack[size] = node.left + 1;
+        masks[size++] = mask;
+        stack[size] = node.left;
+        masks[size++] = mask;
+    }
+}
+
+/**
+ * Merges the vertex ranges of a set of nodes into as few ranges as possible.
+ *
+ * @param bvh The hierarchy.
+ * @param nodes The nodes, as found by cullBVH.
+ * @param ranges Receives sorted, disjoint vertex ranges. Its storage is reused.
+ */
+void vertexRangesOf(const BVH& bvh, const std::vector<uint32_t>& nodes, std::vector<IndexRange>& ranges)
+{
+    ranges.clear();
+    for (uint32_t node : nodes) ranges.push_back(bvh.nodes[node].vertices);
+    std::sort(ranges.begin(), ranges.end(), [](const IndexRange& a, const IndexRange& b) { return a.begin < b.begin; });
+
+    size_t merged = 0;
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        if (merged > 0 && ranges[i].begin <= ranges[merged - 1].end)
+        {
+            ranges[merged - 1].end = std::max(ranges[merged - 1].end, ranges[i].end);
+        }
+        else
+        {
+            ranges[merged++] = ranges[i];
+        }
+    }
+    ranges.resize(merged);
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Camera.h"
+
+// Frames drawn before timing starts, so caches and the thread pool are warm.
+#define BENCH_WARMUP_FRAMES 3
+
+// How much slower than the baseline a case's median frame may be before it counts as a regression.
+#define BENCH_TOLERANCE 0.10
+
+/**
+ * The ways a benchmark camera can move.
+ */
+enum CameraMotion
+{
+  // Once around the target, level with it plus the height.
+  CAMERA_ORBIT,
+  // Back and forth across the front of the target, 45 degrees either side.
+  CAMERA_SWAY,
+  // Straight towards the target, from the distance to a tenth of it.
+  CAMERA_DOLLY,
+  // Across the target from one side to the other, looking down at it.
+  CAMERA_FLYOVER
+};
+
+/**
+ * A camera path that depends only on how far along it the camera is, so
+ * every run of a benchmark sees exactly the same frames however fast it is.
+ */
+struct CameraPath
+{
+  CameraMotion motion;
+  glm::vec3 target;
+  float distance;
+  float height;
+};
+
+/**
+ * @param path The path.
+ * @param t How far along the path the camera is, from 0 at the start to 1 at the end.
+ * @return The camera's camera-to-world matrix at that point.
+ */
+glm::mat4x4 cameraOnPath(const CameraPath& path, float t)
+{
+  float angle = 0.0f;
+  switch (path.motion)
+  {
+    case CAMERA_ORBIT:
+      angle = 2.0f * (float) M_PI * t;
+      break;
+    case CAMERA_SWAY:
+      angle = 0.25f * (float) M_PI * std::sin(2.0f * (float) M_PI * t);
+      break;
+    case CAMERA_DOLLY:
+      return lookAt(path.target + glm::vec3(0.0f, path.height, path.distance * (1.0f - 0.9f * t)), path.target);
+    case CAMERA_FLYOVER:
+    {
+      glm::vec3 across(path.distance * (2.0f * t - 1.0f), 0.0f, 0.0f);
+      return lookAt(path.target + across + glm::vec3(0.0f, path.height, path.distance * 0.5f), path.target + across * 0.5f);
+    }
+  }
+  return lookAt(path.target + glm::vec3(path.distance * std::sin(angle), path.height, path.distance * std::cos(angle)), path.target);
+}
+
+/**
+ * The timings of one benchmark case.
+ */
+struct BenchmarkResult
+{
+  std::string name;
+  std::vector<double> frameMilliseconds;
+  // The triangles submitted to the rasterizer over all the timed frames, after
+  // BVH leaves and instances outside the view are culled. Ray traced cases submit none.
+  double triangles;
+  // The pixels drawn to over all the timed frames.
+  double pixels;
+
+  double totalSeconds() const
+  {
+    double total = 0.0;
+    for (double ms : frameMilliseconds) total += ms;
+    return total / 1000.0;
+  }
+
+  /**
+   * @param fraction Which percentile, from 0 for the fastest frame to 1 for the slowest.
+   * @return The frame time at that percentile, in milliseconds, by the nearest rank.
+   */
+  double percentile(double fraction) const
+  {
+    if (frameMilliseconds.empty()) return 0.0;
+    std::vector<double> sorted(frameMilliseconds);
+    std::sort(sorted.begin(), sorted.end());
+    size_t rank = (size_t) std::ceil(fraction * sorted.size());
+    return sorted[std::min(std::max(rank, (size_t) 1), sorted.size()) - 1];
+  }
+
+  double framesPerSecond() const
+  {
+    double seconds = totalSeconds();
+    return seconds > 0 ? frameMilliseconds.size() / seconds : 0.0;
+  }
+
+  double trianglesPerSecond() const
+  {
+    double seconds = totalSeconds();
+    return seconds > 0 ? triangles / seconds : 0.0;
+  }
+
+  double pixelsPerSecond() const
+  {
+    double seconds = totalSeconds();
+    return seconds > 0 ? pixels / seconds : 0.0;
+  }
+};
+
+/**
+ * Prints a table of results.
+ */
+void printResults(const std::vector<BenchmarkResult>& results)
+{
+  printf("%-24s %8s %9s %9s %9s %9s %12s %12s\n", "case", "fps", "p50 ms", "p90 ms", "p99 ms", "max ms", "Mtris/s", "Mpixels/s");
+  for (const BenchmarkResult& r : results)
+  {
+    printf("%-24s %8.1f %9.3f %9.3f %9.3f %9.3f %12.2f %12.2f\n", r.name.c_str(), r.framesPerSecond(),
+           r.percentile(0.5), r.percentile(0.9), r.percentile(0.99), r.percentile(1.0),
+           r.trianglesPerSecond() / 1e6, r.pixelsPerSecond() / 1e6);
+  }
+}
+
+/**
+ * Writes results as CSV, in the form readBaseline reads back.
+ *
+ * @param fileName The file to write.
+ * @param results The results.
+ * @return False if the file could not be written.
+ */
+bool writeResults(const char* fileName, const std::vector<BenchmarkResult>& results)
+{
+  FILE* file = fopen(fileName, "w");
+  if (file == NULL) return false;
+
+  fprintf(file, "case,frames,fps,p50_ms,p90_ms,p99_ms,max_ms,triangles_per_sec,pixels_per_sec\n");
+  for (const BenchmarkResult& r : results)
+  {
+    fprintf(file, "%s,%d,%.3f,%.4f,%.4f,%.4f,%.4f,%.0f,%.0f\n", r.name.c_str(), (int) r.frameMilliseconds.size(),
+            r.framesPerSecond(), r.percentile(0.5), r.percentile(0.9), r.percentile(0.99), r.percentile(1.0),
+            r.trianglesPerSecond(), r.pixelsPerSecond());
+  }
+  return fclose(file) == 0;
+}
+
+/**
+ * A case's median frame time from an earlier run.
+ */
+struct BaselineEntry
+{
+  std::string name;
+  double medianMilliseconds;
+};
+
+/**
+ * Reads the median frame times out of results written by writeResults.
+ *
+ * @param fileName The file to read.
+ * @param baseline Receives one entry per case.
+ * @return False if the file could not be read.
+ */
+bool readBaseline(const char* fileName, std::vector<BaselineEntry>& baseline)
+{
+  FILE* file = fopen(fileName, "r");
+  if (file == NULL) return false;
+
+  baseline.clear();
+  char line[512];
+  bool header = true;
+  while (fgets(line, sizeof(line), file) != NULL)
+  {
+    if (header)
+    {
+      header = false;
+      continue;
+    }
+    char* comma = strchr(line, ',');
+    if (comma == NULL) continue;
+
+    BaselineEntry entry;
+    entry.name = std::string(line, comma);
+    int frames;
+    double fps;
+    if (sscanf(comma + 1, "%d,%lf,%lf", &frames, &fps, &entry.medianMilliseconds) == 3) baseline.push_back(entry);
+  }
+  fclose(file);
+  return true;
+}
+
+/**
+ * Compares each case's median frame time against a baseline and prints the change.
+ *
+ * @param results The results of this run.
+ * @param baseline The results of an earlier run.
+ * @return The number of cases more than BENCH_TOLERANCE slower than their baseline.
+ */
+int compareToBaseline(const std::vector<BenchmarkResult>& results, const std::vector<BaselineEntry>& baseline)
+{
+  int regressions = 0;
+  for (const BenchmarkResult& r : results)
+  {
+    const BaselineEntry* entry = NULL;
+    for (const BaselineEntry& b : baseline)
+    {
+      if (b.name == r.name) entry = &b;
+    }
+    if (entry == NULL || entry->medianMilliseconds <= 0)
+    {
+      printf("%-24s no baseline\n", r.name.c_str());
+      continue;
+    }
+
+    double change = r.percentile(0.5) / entry->medianMilliseconds - 1.0;
+    bool regressed = change > BENCH_TOLERANCE;
+    if (regressed) ++regressions;
+    printf("%-24s %9.3f ms -> %9.3f ms %+7.1f%%%s\n", r.name.c_str(), entry->medianMilliseconds, r.percentile(0.5),
+           change * 100.0, regressed ? "  REGRESSION" : "");
+  }
+  return regressions;
+}
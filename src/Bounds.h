@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+#include <glm/glm.hpp>
+
+/**
+ * An axis-aligned bounding box. A default constructed box is empty and
+ * grows to fit whatever is added to it.
+ */
+struct AABB
+{
+    glm::vec3 min, max;
+
+    AABB()
+    : min(FLT_MAX, FLT_MAX, FLT_MAX)
+    , max(-FLT_MAX, -FLT_MAX, -FLT_MAX)
+    {}
+
+    bool isEmpty() const
+    {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    void grow(const glm::vec3& point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void grow(const AABB& box)
+    {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+
+    glm::vec3 centre() const
+    {
+        return (min + max) * 0.5f;
+    }
+
+    glm::vec3 extent() const
+    {
+        return max - min;
+    }
+
+    /**
+     * @return The area of the box's six faces, or 0 if it is empty.
+     */
+    float surfaceArea() const
+    {
+        if (isEmpty()) return 0.0f;
+        glm::vec3 e = extent();
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+};
+
+/**
+ * Bounds a box after an affine transform.
+ *
+ * @param box The box.
+ * @param m A 4x4 affine matrix.
+ * @return The smallest axis-aligned box holding the transformed box, which is empty if the box is.
+ */
+AABB transformBox(const AABB& box, const glm::mat4x4& m)
+{
+    if (box.isEmpty()) return box;
+    glm::vec3 centre = box.centre();
+    glm::vec3 half = box.extent() * 0.5f;
+
+    AABB result;
+    for (int i = 0; i < 3; ++i)
+    {
+        float c = m[0][i] * centre.x + m[1][i] * centre.y + m[2][i] * centre.z + m[3][i];
+        float h = std::abs(m[0][i]) * half.x + std::abs(m[1][i]) * half.y + std::abs(m[2][i]) * half.z;
+        result.min[i] = c - h;
+        result.max[i] = c + h;
+    }
+    return result;
+}
+
+// Planes of a view frustum: left, right, top, bottom and near.
+#define FRUSTUM_PLANES 5
+#define FRUSTUM_ALL_PLANES ((1 << FRUSTUM_PLANES) - 1)
+
+/**
+ * The volume the camera sees, as world space planes whose normals point
+ * inwards: a point p is inside a plane when dot(plane, vec4(p, 1)) >= 0.
+ */
+struct Frustum
+{
+    glm::vec4 planes[FRUSTUM_PLANES];
+};
+
+/**
+ * Builds the frustum of the perspective projection done by project2D and transformVertices.
+ *
+ * The side planes pass through the edges of the canvas, so anything the
+ * rasterizer can draw is inside. The near plane is the camera plane itself,
+ * matching the rasterizer's rejection of vertices at or behind the camera.
+ *
+ * @param worldToCamera A 4x4 affine matrix that maps points from the world space to the camera space.
+ * @param focalLength The focal length of the camera.
+ * @param canvasWidth The width of the canvas points are projected to in scale relative to values in world space.
+ * @param canvasHeight The height of the canvas points are projected to in scale relative to values in world space.
+ * @return The frustum in world space.
+ */
+Frustum frustumFromCamera(const glm::mat4x4& worldToCamera, float focalLength, float canvasWidth, float canvasHeight)
+{
+    // Camera space planes. The camera looks down -z, and a point is on
+    // screen when focalLength * |x| <= canvasWidth / 2 * -z.
+    glm::vec4 camera[FRUSTUM_PLANES] = {
+        glm::vec4(focalLength, 0, -canvasWidth / 2.0f, 0),
+        glm::vec4(-focalLength, 0, -canvasWidth / 2.0f, 0),
+        glm::vec4(0, -focalLength, -canvasHeight / 2.0f, 0),
+        glm::vec4(0, focalLength, -canvasHeight / 2.0f, 0),
+        glm::vec4(0, 0, -1, 0)
+    };
+
+    // A plane P in camera space is the plane transpose(worldToCamera) * P in world space.
+    Frustum frustum;
+    for (int i = 0; i < FRUSTUM_PLANES; ++i)
+    {
+        for (int j = 0; j < 4; ++j)
+        {
+            frustum.planes[i][j] = glm::dot(camera[i], worldToCamera[j]);
+        }
+    }
+    return frustum;
+}
+
+/**
+ * Tests a box against the planes of a frustum that still need testing.
+ *
+ * @param frustum The frustum.
+ * @param box The box.
+ * @param planeMask The planes to test, one bit each. Planes a parent box was wholly inside can be left out.
+ * @return The planes the box straddles, 0 if it is wholly inside, or -1 if it is wholly outside one of them.
+ */
+int cullBox(const Frustum& frustum, const AABB& box, int planeMask)
+{
+    int straddled = 0;
+    for (int i = 0; i < FRUSTUM_PLANES; ++i)
+    {
+        if (!(planeMask & (1 << i))) continue;
+        const glm::vec4& plane = frustum.planes[i];
+
+        // The corners furthest along and against the plane normal.
+        glm::vec3 far(plane.x >= 0 ? box.max.x : box.min.x, plane.y >= 0 ? box.max.y : box.min.y, plane.z >= 0 ? box.max.z : box.min.z);
+        glm::vec3 near(plane.x >= 0 ? box.min.x : box.max.x, plane.y >= 0 ? box.min.y : box.max.y, plane.z >= 0 ? box.min.z : box.max.z);
+
+        if (plane.x * far.x + plane.y * far.y + plane.z * far.z + plane.w < 0) return -1;
+        if (plane.x * near.x + plane.y * near.y + plane.z * near.z + plane.w < 0) straddled |= 1 << i;
+    }
+    return straddled;
+}
@@ -2,7 +2,6 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <ModelTriangle.h>
 #include <CanvasTriangle.h>
 
 using namespace glm;
@@ -81,7 +80,8 @@ mat4x4 constructCameraSpace(const vec3& pos, const vec3& angle)
  * @param canvasHeight The height of the canvas points are projected to in scale relative to values in world space.
  * @param imageWidth The width of the window points are to be drawn on to.
  * @param imageHeight The height of the window points are to be drawn on to.
- * @return 2D projection of the provided 3D point.
+ * @return 2D projection of the provided 3D point. Points at or behind the camera get a depth <= 0
+ *         and meaningless x and y; triangles using them must go through clipTriangle instead.
  */
 CanvasPoint project2D(const vec3& pointWorldSpace, const mat4x4& worldToCamera, float focalLength,
                       float canvasWidth, float canvasHeight,
@@ -102,41 +102,13 @@ CanvasPoint project2D(const vec3& pointWorldSpace, const mat4x4& worldToCamera,
 
     // Convert to pixel coords.
     CanvasPoint pRaster;
-    pRaster.x = std::floor(pNDC.x * imageWidth);
-    pRaster.y = std::floor((1.0f - pNDC.y) * imageHeight);
+    pRaster.x = pNDC.x * imageWidth;
+    pRaster.y = (1.0f - pNDC.y) * imageHeight;
     pRaster.depth = -1.0f/pointCamSpace.z;
 
     return pRaster;
 }
 
-/**
- * Project a 3D vector in world space to a 2D CanvasPoint in screen space.
- *
- * @param modelTriangle A 3D Triangle in world space.
- * @param worldToCamera 4x4 matrix that maps points from the world space to the camera space.
- * @param focalLength The focal length of the camera.
- * @param canvasWidth The width of the canvas points are projected to in scale relative to values in world space.
- * @param canvasHeight The height of the canvas points are projected to in scale relative to values in world space.
- * @param imageWidth The width of the window points are to be drawn on to.
- * @param imageHeight The height of the window points are to be drawn on to.
- * @return canvasTriangle The 2D projection of the provided 3D triangle.
- */
-CanvasTriangle projectTriangle(const ModelTriangle& modelTriangle, const mat4x4& worldToCamera, float focalLength,
-                               float canvasWidth, float canvasHeight,
-                               float imageWidth, float imageHeight)
-{
-    CanvasTriangle canvasTriangle;
-    for (int i = 0; i < 3; ++i)
-    {
-        CanvasPoint projected = project2D(modelTriangle.vertices[i], worldToCamera, focalLength, canvasWidth, canvasHeight, imageWidth, imageHeight);
-        canvasTriangle.vertices[i] = projected;
-        canvasTriangle.colour = modelTriangle.colour;
-    }
-
-    return canvasTriangle;
-}
-
-
 void rotateX(mat4x4& cameraToWorld, float X)
 {
     float values[16] = {
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <utility>
+#include <CanvasTriangle.h>
+#include <glm/glm.hpp>
+
+// Geometry nearer the camera than this is clipped away.
+#define NEAR_PLANE 0.01f
+
+// Triangles reaching more than this many pixels past any edge of the
+// screen are clipped to this band; anything smaller is left to the
+// rasterizer's bounding box, which is already clipped to the screen.
+#define CLIP_GUARD_BAND 2048.0f
+
+// Planes a triangle is clipped against: near, then the four guard band sides.
+#define CLIP_PLANES 5
+
+// A triangle clipped by every plane gains at most one vertex per plane.
+#define MAX_CLIP_VERTICES (3 + CLIP_PLANES)
+
+/**
+ * A vertex in camera space, with the attributes carried through clipping.
+ */
+struct ClipVertex
+{
+  glm::vec3 position;
+  float u, v;
+};
+
+/**
+ * The projection of the vertex stage, with the planes triangles are clipped against.
+ */
+struct ClipSpace
+{
+  float scaleX, scaleY, offsetX, offsetY;
+  float minX, minY, maxX, maxY;
+  float maxDepth;
+
+  // Camera space planes whose normals point inwards, as in Frustum.
+  // Guard band planes first use the band, then the screen edges for trivial rejection.
+  glm::vec4 planes[CLIP_PLANES];
+  glm::vec4 screenPlanes[CLIP_PLANES];
+};
+
+/**
+ * Sets up clipping for the projection done by project2D and transformVertices.
+ *
+ * @param focalLength The focal length of the camera.
+ * @param canvasWidth The width of the canvas points are projected to in scale relative to values in world space.
+ * @param canvasHeight The height of the canvas points are projected to in scale relative to values in world space.
+ * @param imageWidth The width of the window points are to be drawn on to.
+ * @param imageHeight The height of the window points are to be drawn on to.
+ */
+ClipSpace makeClipSpace(float focalLength, float canvasWidth, float canvasHeight, float imageWidth, float imageHeight)
+{
+  ClipSpace clip;
+  clip.scaleX = focalLength * imageWidth / canvasWidth;
+  clip.scaleY = focalLength * imageHeight / canvasHeight;
+  clip.offsetX = imageWidth / 2.0f;
+  clip.offsetY = imageHeight / 2.0f;
+  clip.minX = -CLIP_GUARD_BAND;
+  clip.minY = -CLIP_GUARD_BAND;
+  clip.maxX = imageWidth + CLIP_GUARD_BAND;
+  clip.maxY = imageHeight + CLIP_GUARD_BAND;
+  clip.maxDepth = 1.0f / NEAR_PLANE;
+
+  // With w = -z, a point projects to x = offsetX + scaleX * camX / w, so
+  // x >= left is scaleX * camX + (offsetX - left) * w >= 0, and so on.
+  for (int band = 0; band < 2; ++band)
+  {
+    float margin = band == 0 ? CLIP_GUARD_BAND : 0.0f;
+    glm::vec4* planes = band == 0 ? clip.planes : clip.screenPlanes;
+    planes[0] = glm::vec4(0, 0, -1, -NEAR_PLANE);
+    planes[1] = glm::vec4(clip.scaleX, 0, -(clip.offsetX + margin), 0);
+    planes[2] = glm::vec4(-clip.scaleX, 0, -(imageWidth + margin - clip.offsetX), 0);
+    planes[3] = glm::vec4(0, -clip.scaleY, -(clip.offsetY + margin), 0);
+    planes[4] = glm::vec4(0, clip.scaleY, -(imageHeight + margin - clip.offsetY), 0);
+  }
+  return clip;
+}
+
+/**
+ * Which triangles are thrown away by their facing. A triangle faces the
+ * camera when its vertices wind anticlockwise on screen, as in OBJ files.
+ */
+enum FaceCulling
+{
+  CULL_NONE,
+  CULL_BACK,
+  CULL_FRONT
+};
+
+/**
+ * @param culling Which faces are culled.
+ * @return The culling that throws away the same faces of a mirrored mesh, whose triangles wind the other way.
+ */
+inline FaceCulling mirrorCulling(FaceCulling culling)
+{
+  return culling == CULL_BACK ? CULL_FRONT : (culling == CULL_FRONT ? CULL_BACK : CULL_NONE);
+}
+
+/**
+ * Tests the facing of a triangle whose vertices are all in front of the camera.
+ *
+ * @param culling Which faces are culled.
+ * @param v0 The first vertex, in pixels.
+ * @param v1 The second vertex, in pixels.
+ * @param v2 The third vertex, in pixels.
+ * @return True if the triangle is to be thrown away.
+ */
+inline bool isCulled(FaceCulling culling, const CanvasPoint& v0, const CanvasPoint& v1, const CanvasPoint& v2)
+{
+  if (culling == CULL_NONE) return false;
+
+  // Rows run down the screen, so anticlockwise triangles have negative area.
+  float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+  return culling == CULL_BACK ? area >= 0 : area <= 0;
+}
+
+/**
+ * Tests the facing of a camera space triangle, which may cross the camera plane.
+ *
+ * @param culling Which faces are culled.
+ * @param triangle The triangle's vertices.
+ * @return True if the triangle is to be thrown away.
+ */
+inline bool isCulled(FaceCulling culling, const ClipVertex triangle[3])
+{
+  if (culling == CULL_NONE) return false;
+
+  // The triangle faces the camera, at the origin, when its normal points back towards it.
+  const glm::vec3& p0 = triangle[0].position;
+  float facing = glm::dot(glm::cross(triangle[1].position - p0, triangle[2].position - p0), p0);
+  return culling == CULL_BACK ? facing >= 0 : facing <= 0;
+}
+
+/**
+ * Whether a projected vertex can be drawn without clipping: it is beyond
+ * the near plane and within the guard band.
+ */
+inline bool isUnclipped(const ClipSpace& clip, float x, float y, float depth)
+{
+  return depth > 0 && depth <= clip.maxDepth && x >= clip.minX && x <= clip.maxX && y >= clip.minY && y <= clip.maxY;
+}
+
+inline float planeDistance(const glm::vec4& plane, const glm::vec3& p)
+{
+  return plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w;
+}
+
+/**
+ * Clips a camera space triangle against the near plane and the guard band,
+ * Sutherland-Hodgman style, and projects what is left.
+ *
+ * @param clip The clip space.
+ * @param triangle The triangle's vertices.
+ * @param out Receives the vertices of the clipped convex polygon, in pixels, with
+ *            their texture coordinates in texturePoint. Draw it as a fan around out[0].
+ * @return The number of vertices in out, or 0 if nothing of the triangle is on screen.
+ */
+int clipTriangle(const ClipSpace& clip, const ClipVertex triangle[3], CanvasPoint out[MAX_CLIP_VERTICES])
+{
+  // Triangles wholly outside one plane of the visible volume are rejected outright.
+  for (int i = 0; i < CLIP_PLANES; ++i)
+  {
+    const glm::vec4& plane = clip.screenPlanes[i];
+    if (planeDistance(plane, triangle[0].position) < 0 && planeDistance(plane, triangle[1].position) < 0 &&
+        planeDistance(plane, triangle[2].position) < 0) return 0;
+  }
+
+  ClipVertex buffers[2][MAX_CLIP_VERTICES];
+  ClipVertex* polygon = buffers[0];
+  ClipVertex* next = buffers[1];
+  int count = 3;
+  for (int i = 0; i < 3; ++i) polygon[i] = triangle[i];
+
+  for (int i = 0; i < CLIP_PLANES && count > 0; ++i)
+  {
+    const glm::vec4& plane = clip.planes[i];
+    int kept = 0;
+    for (int j = 0; j < count; ++j)
+    {
+      const ClipVertex& a = polygon[j];
+      const ClipVertex& b = polygon[(j + 1) % count];
+      float da = planeDistance(plane, a.position);
+      float db = planeDistance(plane, b.position);
+
+      if (da >= 0) next[kept++] = a;
+      if ((da >= 0) != (db >= 0))
+      {
+        float t = da / (da - db);
+        ClipVertex& c = next[kept++];
+        c.position = a.position + (b.position - a.position) * t;
+        c.u = a.u + (b.u - a.u) * t;
+        c.v = a.v + (b.v - a.v) * t;
+      }
+    }
+    std::swap(polygon, next);
+    count = kept;
+  }
+
+  for (int i = 0; i < count; ++i)
+  {
+    const ClipVertex& c = polygon[i];
+    float invZ = 1.0f / -c.position.z;
+    out[i] = CanvasPoint(clip.offsetX + clip.scaleX * c.position.x * invZ, clip.offsetY - clip.scaleY * c.position.y * invZ, invZ);
+    out[i].texturePoint = TexturePoint(c.u, c.v);
+  }
+  return count < 3 ? 0 : count;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cmath>
+#include <cstring>
+#include <inttypes.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "BVH.h"
+
+// Sort keys are the top bits of a float depth: sign, exponent and 7 bits
+// of mantissa, so depths under 1% apart may share a key.
+#define DRAW_KEY_BITS 16
+#define DRAW_RADIX_BITS 8
+#define DRAW_RADIX_SIZE (1 << DRAW_RADIX_BITS)
+
+/**
+ * A batch of triangles to draw, with the key it is sorted by.
+ */
+struct DrawItem
+{
+    uint32_t key;
+    uint32_t node;
+};
+
+/**
+ * Quantizes a view space depth into a sort key. Non-negative floats
+ * compare the same as their bit patterns, so no depth range is needed.
+ *
+ * @param depth A distance in front of the camera. Anything less than 0 sorts as 0.
+ * @return A key of DRAW_KEY_BITS bits that increases with depth.
+ */
+inline uint32_t depthKey(float depth)
+{
+    if (!(depth > 0.0f)) return 0;
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    return bits >> (32 - DRAW_KEY_BITS);
+}
+
+/**
+ * Sorts draw items by key, least significant digit first. Items with equal
+ * keys keep their order, so equally near batches are drawn as they came.
+ *
+ * @param items The items to sort.
+ * @param scratch Storage the passes alternate with. It is reused between calls.
+ */
+void radixSort(std::vector<DrawItem>& items, std::vector<DrawItem>& scratch)
+{
+    scratch.resize(items.size());
+    for (int shift = 0; shift < DRAW_KEY_BITS; shift += DRAW_RADIX_BITS)
+    {
+        uint32_t starts[DRAW_RADIX_SIZE + 1] = {0};
+        for (const DrawItem& item : items) ++starts[((item.key >> shift) & (DRAW_RADIX_SIZE - 1)) + 1];
+
+        // A digit every item shares leaves the order as it is.
+        bool shared = false;
+        for (int digit = 1; digit <= DRAW_RADIX_SIZE && !shared; ++digit) shared = starts[digit] == items.size();
+        if (shared) continue;
+
+        for (int digit = 1; digit <= DRAW_RADIX_SIZE; ++digit) starts[digit] += starts[digit - 1];
+        for (const DrawItem& item : items) scratch[starts[(item.key >> shift) & (DRAW_RADIX_SIZE - 1)]++] = item;
+        items.swap(scratch);
+    }
+}
+
+/**
+ * Lists the leaves of the visible parts of a BVH nearest first, so the
+ * triangles hiding others are drawn before them and as few pixels as
+ * possible are drawn more than once.
+ *
+ * @param bvh The hierarchy.
+ * @param nodes The visible nodes, as found by cullBVH.
+ * @param worldToCamera A 4x4 affine matrix that maps points from the world space to the camera space.
+ * @param items Receives a leaf per item, keyed by the depth of the nearest point of its bounds. Its storage is reused.
+ * @param scratch Storage for the sort. It is reused between calls.
+ */
+void sortFrontToBack(const BVH& bvh, const std::vector<uint32_t>& nodes, const glm::mat4x4& worldToCamera,
+                     std::vector<DrawItem>& items, std::vector<DrawItem>& scratch)
+{
+    items.clear();
+
+    // The camera looks down -z, so depth is minus the camera space z row.
+    glm::vec3 axis(-worldToCamera[0][2], -worldToCamera[1][2], -worldToCamera[2][2]);
+    glm::vec3 reach(std::abs(axis.x), std::abs(axis.y), std::abs(axis.z));
+    float offset = -worldToCamera[3][2];
+
+    // Wholly visible subtrees are opened up to their leaves so the order is fine grained.
+    uint32_t stack[64];
+    for (uint32_t root : nodes)
+    {
+        int size = 0;
+        stack[size++] = root;
+        while (size > 0)
+        {
+            const BVHNode& node = bvh.nodes[stack[--size]];
+            if (node.left != 0)
+            {
+                stack[size++] = node.left + 1;
+                stack[size++] = node.left;
+                continue;
+            }
+
+            glm::vec3 centre = node.bounds.centre();
+            glm::vec3 half = node.bounds.extent() * 0.5f;
+            DrawItem item;
+            item.key = depthKey(glm::dot(axis, centre) + offset - glm::dot(reach, half));
+            item.node = &node - bvh.nodes.data();
+            items.push_back(item);
+        }
+    }
+
+    radixSort(items, scratch);
+}
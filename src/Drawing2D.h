@@ -1,40 +1,47 @@
 #pragma once
 
-#include <ModelTriangle.h>
+#include <inttypes.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <CanvasTriangle.h>
-#include <DrawingWindow.h>
-#include <Utils.h>
 #include <glm/glm.hpp>
+#include "FrameBuffer.h"
 #include "Image.h"
 #include "Interpolation.h"
+#include "PixelUtil.h"
+#include "Rasterizer.h"
+#include "Texture.h"
+
+// Flat 2D drawing, with no depth test. The depth tested line and outline are in Drawing3D.h.
 
 /**
- * Draw an image to a window.
+ * Draw an image into a frame buffer.
  *
  * @param img A loaded image.
- * @param window The window the image is to be drawn onto.
+ * @param frame The frame buffer the image is to be drawn into.
  */
-void drawImage(const Image& img, DrawingWindow& window)
+void drawImage(const Image& img, FrameBuffer& frame)
 {
   for (int y = 0; y < img.getHeight(); ++y)
   {
     for (int x = 0; x < img.getWidth(); ++x)
     {
       uint32_t colour = img.GetPixel(x, y);
-      window.setPixelColour(x, y, colour);
+      frame.setPixel(x, y, colour);
     }
   }
 }
 
 /**
- * Draws a line on a window between two canvas points.
+ * Draws a line into a frame buffer between two canvas points, ignoring depth.
  *
  * @param from The first point of the line.
  * @param to The second point of the line.
  * @param colour A bitpacked RGB colour of the line.
- * @param window The window the image is to be drawn onto.
+ * @param frame The frame buffer the image is to be drawn into.
  */
-void drawLine(const CanvasPoint& from, const CanvasPoint& to, uint32_t colour, DrawingWindow& window)
+void drawLine2D(const CanvasPoint& from, const CanvasPoint& to, uint32_t colour, FrameBuffer& frame)
 {
   float xFrom = from.x;
   float yFrom = from.y;
@@ -46,40 +53,40 @@ void drawLine(const CanvasPoint& from, const CanvasPoint& to, uint32_t colour, D
   if (xTo < 0) xTo = 0;
   if (yTo < 0) yTo = 0;
 
-  if (xFrom > window.width) xFrom = window.width - 1;
-  if (yFrom > window.height) yFrom = window.height - 1;
-  if (xTo > window.width) xTo = window.width - 1;
-  if (yTo > window.height) yTo = window.height - 1; 
+  if (xFrom > frame.width) xFrom = frame.width - 1;
+  if (yFrom > frame.height) yFrom = frame.height - 1;
+  if (xTo > frame.width) xTo = frame.width - 1;
+  if (yTo > frame.height) yTo = frame.height - 1; 
 
   float xDiff = xTo - xFrom;
   float yDiff = yTo - yFrom;
-  float numberOfSteps = std::max(abs(xDiff), std::abs(yDiff));
+  float numberOfSteps = std::max(std::abs(xDiff), std::abs(yDiff));
   float xStepSize = xDiff/numberOfSteps;
   float yStepSize = yDiff/numberOfSteps;
 
   for (float i=0.0; i<numberOfSteps; i++) {
     float x = xFrom + (xStepSize*i);
     float y = yFrom + (yStepSize*i);
-    if (x > 0 && x < window.width - 1 && y < window.height - 1 && y > 0)
+    if (x > 0 && x < frame.width - 1 && y < frame.height - 1 && y > 0)
     {
-      window.setPixelColour(round(x), round(y), colour);
+      frame.setPixel(round(x), round(y), colour);
     }
   }
 }
 
 /**
- * Draws a triangle onto the window.
+ * Draws the outline of a triangle into a frame buffer, ignoring depth.
  *
  * @param triangle CanvasTriangle to be drawn.
  * @param colour A bitpacked RGB colour of the line.
- * @param window The window the image is to be drawn onto.
+ * @param frame The frame buffer the image is to be drawn into.
  */
-void drawTriangle(const CanvasTriangle& triangle, uint32_t colour, DrawingWindow& window)
+void drawTriangle2D(const CanvasTriangle& triangle, uint32_t colour, FrameBuffer& frame)
 {
   int j = 2;
   for (int i = 0; i < 3; ++i)
   {
-    drawLine(triangle.vertices[i], triangle.vertices[j], colour, window);
+    drawLine2D(triangle.vertices[i], triangle.vertices[j], colour, frame);
     j = i;
   }
 }
@@ -99,12 +106,12 @@ void sortVertices(CanvasTriangle& triangle)
 }
 
 /**
- * Fills a triangle onto the window.
+ * Fills a triangle into a frame buffer.
  *
  * @param triangle CanvasTriangle to be filled.
- * @param window The window the image is to be drawn onto.
+ * @param frame The frame buffer the image is to be drawn into.
  */
-void fillTriangle(CanvasTriangle& triangle, DrawingWindow& window)
+void fillTriangle2D(CanvasTriangle& triangle, FrameBuffer& frame)
 {
   // Sort the vertices of the triangle from smallest to largest.
   sortVertices(triangle);
@@ -118,144 +125,75 @@ void fillTriangle(CanvasTriangle& triangle, DrawingWindow& window)
   float yEnd = maxPoint.y;
 
   // Find the total height of the triangle.
-  // Then interpolate down the Long face of the triangle.
-  // We do this to find the x values of the long side of
+  // Then step down the long face of the triangle, one value
+  // per row, to find the x values of the long side of
   // the triangle for each of the y values between the
   // top and bottom of the triangle.
   int yDiff = yEnd - yStart;
-  std::vector<float> xPointsRHS = interpolate(minPoint.x, maxPoint.x, yDiff);
+  Interpolator<float> xPointsRHS(minPoint.x, maxPoint.x, yDiff + 1);
 
   // Find the distance between the top of the triangle (min point) and the middle point of the triangle (mid point).
-  // Interpolate x's down the top short face of the triangle.
+  // Step x's down the top short face of the triangle.
   int yDiffTop = yMid - yStart;
-  std::vector<float> xPointsLHS1 = interpolate(minPoint.x, midPoint.x, yDiffTop);
+  Interpolator<float> xPointsLHS1(minPoint.x, midPoint.x, yDiffTop + 1);
 
   // Find the distance between the middle point of the triangle (mid point) and the bottom of the triangle (max point).
-  // Interpolate x's down the bottom short face of the triangle.
+  // Step x's down the bottom short face of the triangle.
   int yDiffBtm = yEnd - yMid;
-  std::vector<float> xPointsLHS2 = interpolate(midPoint.x, maxPoint.x, yDiffBtm);
+  Interpolator<float> xPointsLHS2(midPoint.x, maxPoint.x, yDiffBtm + 1);
 
   uint32_t colour = packRGB(triangle.colour.red, triangle.colour.green, triangle.colour.blue);
 
   // Fill top triangle.
   // Draw between x's in the top short face on the LHS and x's on the RHS.
-  for (float y = yStart; y < yMid; ++y)
+  for (float y = yStart; y < yMid; ++y, ++xPointsLHS1, ++xPointsRHS)
   {
-    float x1 = xPointsLHS1[(int) (y - yStart)];
-    float x2 = xPointsRHS[(int) (y - yStart)];
-    drawLine({x1, y}, {x2, y}, colour, window);
+    drawLine2D(CanvasPoint(*xPointsLHS1, y), CanvasPoint(*xPointsRHS, y), colour, frame);
   }
 
   //Fill bottom triangle.
   // Draw between x's in the bottom short face on the LHS and x's on the RHS.
-  for (float y = yMid; y < yEnd; ++y)
+  for (float y = yMid; y < yEnd; ++y, ++xPointsLHS2, ++xPointsRHS)
   {
-    float x1 = xPointsLHS2[(int) (y - yMid)];
-    float x2 = xPointsRHS[(int) (y - yStart)];
-    drawLine({x1, y}, {x2, y}, colour, window);
+    drawLine2D(CanvasPoint(*xPointsLHS2, y), CanvasPoint(*xPointsRHS, y), colour, frame);
   }
 }
 
 /**
- * Fills a triangle onto the window.
+ * Fills a textured triangle into a frame buffer, perspective correct.
  *
- * @param triangle CanvasTriangle to be filled.
- * @pararm image The image used to texture the triangle.
- * @param window The window the image is to be drawn onto.
+ * @param triangle CanvasTriangle to be filled. Its texture points are in texels.
+ * @param texture The texture used to texture the triangle, built once from its image.
+ * @param frame The frame buffer the image is to be drawn into.
  */
-void fillTriangleTexture(CanvasTriangle& triangle, const Image& image, DrawingWindow& window)
+void fillTriangleTexture(CanvasTriangle& triangle, const Texture& texture, FrameBuffer& frame)
 {
-  sortVertices(triangle);
-  CanvasPoint minPoint = triangle.vertices[0];
-  CanvasPoint midPoint = triangle.vertices[1];
-  CanvasPoint maxPoint = triangle.vertices[2];
-
-  float yStart = minPoint.y;
-  float yMid = midPoint.y;
-  float yEnd = maxPoint.y;
-
-  int yDiff = yEnd - yStart;
-  std::vector<float> xPointsRHS = interpolate(minPoint.x, maxPoint.x, yDiff);
-  std::vector<float> xPointsRHST = interpolate(minPoint.texturePoint.x, maxPoint.texturePoint.x, yDiff);
-  
-  std::vector<float> yPointsT = interpolate(minPoint.texturePoint.y, maxPoint.texturePoint.y, yDiff);
-
-
-  int yDiffTop = yMid - yStart;
-  std::vector<float> xPointsLHS1 = interpolate(minPoint.x, midPoint.x, yDiffTop);
-  std::vector<float> xPointsLHS1T = interpolate(minPoint.texturePoint.x, midPoint.texturePoint.x, yDiffTop);
-
-
-  int yDiffBtm = yEnd - yMid;
-  std::vector<float> xPointsLHS2 = interpolate(midPoint.x, maxPoint.x, yDiffBtm);
-  std::vector<float> xPointsLHS2T = interpolate(midPoint.texturePoint.x, maxPoint.texturePoint.x, yDiffBtm);
-
-  //Fill top triangle.
-  for (float y = yStart; y < yMid; ++y)
-  {
-    int iy = (int) (y - yStart);
-    float x1 = xPointsLHS1[iy];
-    float x2 = xPointsRHS[iy];
-
-    float x1T = xPointsLHS1T[iy];
-    float x2T = xPointsRHST[iy];
-
-    float xDiff = x2 - x1;
-
-    std::vector<float> pixelRow = interpolate(x1T, x2T, xDiff);
-
-    for (float x = x1; x <= x2; ++x)
-    {
-      int ix = (int) (x - x1);
-
-      float xt = pixelRow[ix];
-      float yt = yPointsT[iy];
-
-      uint32_t pixel = image.GetPixel(xt, yt);
-      window.setPixelColour(x, y, pixel);
-    }
-  }
-
-  //Fill bottom triangle.
-  for (float y = yMid; y < yEnd; ++y)
+  CanvasPoint v[3];
+  for (int i = 0; i < 3; ++i)
   {
-    int iy = (int) (y - yStart);
-    int iyL = (int) (y - yMid);
+    v[i] = triangle.vertices[i];
+    v[i].texturePoint.x /= texture.getWidth();
+    v[i].texturePoint.y /= texture.getHeight();
 
-    float x1 = xPointsLHS2[iyL];
-    float x2 = xPointsRHS[iy];
-
-    float x1T = xPointsLHS2T[iyL];
-    float x2T = xPointsRHST[iy];
-
-    float xDiff = x2 - x1;
-
-    std::vector<float> pixelRow = interpolate(x1T, x2T, xDiff);
-
-    for (float x = x1; x < x2; ++x)
-    {
-      int ix = (int) (x - x1);
-
-      float xt = pixelRow[ix];
-      float yt = yPointsT[iy];
-
-      uint32_t pixel = image.GetPixel(xt, yt);
-      window.setPixelColour(x, y, pixel);
-    }
+    // Flat 2D triangles carry no depth.
+    if (v[i].depth <= 0) v[i].depth = 1;
   }
+  rasterizeTexturedTriangle(v[0], v[1], v[2], texture, TEXTURE_BILINEAR, TEXTURE_CLAMP, frame, 0, 0, frame.width - 1, frame.height - 1);
 }
 
-void drawRandomTriangle()
+/**
+ * @param frame The frame buffer the triangle is to fit in.
+ * @return A triangle of a random colour with its corners anywhere in the frame.
+ */
+CanvasTriangle randomTriangle(const FrameBuffer& frame)
 {
   int r = rand() % 255;
   int g = rand() % 255;
   int b = rand() % 255;
 
-  CanvasPoint p1(rand() % window.width, rand() % window.height);
-  CanvasPoint p2(rand() % window.width, rand() % window.height);
-  CanvasPoint p3(rand() % window.width, rand() % window.height);
-
-  CanvasTriangle t(p1,p2,p3, Colour(r,g,b));
+  CanvasPoint p1(rand() % frame.width, rand() % frame.height);
+  CanvasPoint p2(rand() % frame.width, rand() % frame.height);
+  CanvasPoint p3(rand() % frame.width, rand() % frame.height);
 
-  triangles.push_back(t);
+  return CanvasTriangle(p1, p2, p3, Colour(r, g, b));
 }
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <inttypes.h>
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Arenas grab memory from the heap in blocks of at least this many bytes.
+#define FRAME_ARENA_BLOCK_SIZE (1 << 20)
+
+// Allocations are aligned to at least this, enough for SSE loads and stores.
+#define FRAME_ARENA_ALIGNMENT 16
+
+/**
+ * A bump allocator for data that lives for one frame.
+ *
+ * Allocating moves a pointer through blocks of memory taken from the heap;
+ * nothing is freed on its own. reset() rewinds to the first block in O(1),
+ * keeping every block for the next frame, so once the arena has grown to
+ * fit the busiest frame it never touches the heap again. Not thread safe:
+ * allocate between parallel loops, not from their jobs.
+ */
+class FrameArena
+{
+private:
+  struct Block
+  {
+    char* memory;
+    size_t size;
+  };
+
+  std::vector<Block> blocks;
+  size_t current;
+  size_t offset;
+  size_t used;
+  size_t peak;
+
+public:
+  FrameArena()
+  : current(0)
+  , offset(0)
+  , used(0)
+  , peak(0)
+  {}
+
+  ~FrameArena()
+  {
+    for (Block& block : blocks) delete[] block.memory;
+  }
+
+  FrameArena(const FrameArena&) = delete;
+  FrameArena& operator=(const FrameArena&) = delete;
+
+  /**
+   * @param bytes The size of the allocation.
+   * @param alignment What its address must be a multiple of. A power of two.
+   * @return Uninitialised memory that stays valid until the next reset.
+   */
+  void* allocate(size_t bytes, size_t alignment = FRAME_ARENA_ALIGNMENT)
+  {
+    alignment = std::max(alignment, (size_t) FRAME_ARENA_ALIGNMENT);
+    while (true)
+    {
+      if (current == blocks.size())
+      {
+        Block block;
+        block.size = std::max((size_t) FRAME_ARENA_BLOCK_SIZE, bytes + alignment);
+        block.memory = new char[block.size];
+        blocks.push_back(block);
+      }
+
+      Block& block = blocks[current];
+      uintptr_t base = (uintptr_t) block.memory;
+      size_t start = ((base + offset + alignment - 1) & ~(uintptr_t) (alignment - 1)) - base;
+      if (start + bytes <= block.size)
+      {
+        used += start + bytes - offset;
+        offset = start + bytes;
+        return block.memory + start;
+      }
+
+      // The rest of this block is too small; it stays unused until the next reset.
+      used += block.size - offset;
+      ++current;
+      offset = 0;
+    }
+  }
+
+  /**
+   * @param count The number of elements.
+   * @return Uninitialised storage for count elements of a trivially destructible type.
+   */
+  template <typename T>
+  T* allocate(size_t count)
+  {
+    return (T*) allocate(count * sizeof(T), alignof(T));
+  }
+
+  /**
+   * Frees everything allocated since the last reset, without returning any memory to the heap.
+   */
+  void reset()
+  {
+    peak = std::max(peak, used);
+    current = 0;
+    offset = 0;
+    used = 0;
+  }
+
+  /**
+   * @return The bytes allocated since the last reset, counting padding and skipped block ends.
+   */
+  size_t bytesUsed() const
+  {
+    return used;
+  }
+
+  /**
+   * @return The most bytes used between any two resets.
+   */
+  size_t peakBytes() const
+  {
+    return std::max(peak, used);
+  }
+
+  /**
+   * @return The bytes taken from the heap.
+   */
+  size_t capacity() const
+  {
+    size_t total = 0;
+    for (const Block& block : blocks) total += block.size;
+    return total;
+  }
+};
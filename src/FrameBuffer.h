@@ -0,0 +1,345 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Depth blocks are this many pixels a side.
+#define DEPTH_BLOCK_BITS 3
+#define DEPTH_BLOCK_SIZE (1 << DEPTH_BLOCK_BITS)
+
+// Colour and depth start on a cache line.
+#define FRAME_ALIGNMENT 64
+
+// Clear tiles are this many pixels a side; the frame remembers which of them are still clear.
+#define CLEAR_TILE_BITS 6
+#define CLEAR_TILE_SIZE (1 << CLEAR_TILE_BITS)
+
+/**
+ * @param count The number of elements.
+ * @return Uninitialised storage for them aligned to FRAME_ALIGNMENT, to be released with free().
+ */
+template <typename T>
+T* allocateAligned(size_t count)
+{
+  void* memory = NULL;
+  if (posix_memalign(&memory, FRAME_ALIGNMENT, std::max(count, (size_t) 1) * sizeof(T)) != 0) throw std::bad_alloc();
+  return (T*) memory;
+}
+
+/**
+ * Fills a buffer with a 4 byte value using non-temporal stores, which
+ * bypass the cache, for whole buffers too big to still be in it when they
+ * are next read.
+ *
+ * @param buffer The first element.
+ * @param count The number of elements.
+ * @param value The value.
+ */
+template <typename T>
+void streamFill(T* buffer, size_t count, T value)
+{
+  static_assert(sizeof(T) == 4, "streamFill writes 4 byte elements");
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  for (; i < count && ((uintptr_t) (buffer + i) & 15) != 0; ++i) buffer[i] = value;
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  __m128i lanes = _mm_set1_epi32((int) bits);
+  for (; i + 4 <= count; i += 4) _mm_stream_si128((__m128i*) (buffer + i), lanes);
+  _mm_sfence();
+#endif
+
+  for (; i < count; ++i) buffer[i] = value;
+}
+
+/**
+ * An in-memory render target the rasterizer writes into directly.
+ *
+ * Colours are stored row-major as packed ARGB, the same layout
+ * DrawingWindow uses. Depth is stored as 1/z so larger values are
+ * nearer to the camera and a cleared buffer (0) is infinitely far away.
+ *
+ * Over the depth buffer sits a coarse level of 8x8 pixel blocks, each
+ * holding a value no greater than the farthest depth inside it. Depth
+ * only ever moves nearer between clears, so a stale value is still a
+ * safe bound. The rasterizer raises it when a triangle covers a whole
+ * block, marks blocks it covers partly as stale, and refreshes a stale
+ * block from the depth buffer only when a later triangle needs it.
+ *
+ * The frame is also split into 64x64 pixel clear tiles, each remembering
+ * whether it still holds nothing but one clear colour and far depth.
+ * clearTiles() skips tiles that do, so the parts of the screen nothing is
+ * drawn to are not cleared again every frame. Everything that writes to
+ * the frame other than through clearTiles() must mark what it writes as
+ * dirty; the rasterizer, clearRect() and setPixel() do so themselves.
+ */
+class FrameBuffer
+{
+public:
+  int width, height;
+  uint32_t* pixels;
+  float* depth;
+
+  int blocksX, blocksY;
+  float* blockMin;
+  uint8_t* blockStale;
+
+  // For each clear tile, whether it is still clear, and to what colour.
+  int clearTilesX, clearTilesY;
+  uint8_t* tileClear;
+  uint32_t* tileColour;
+
+private:
+  void allocate()
+  {
+    pixels = allocateAligned<uint32_t>(width * height);
+    depth = allocateAligned<float>(width * height);
+    blocksX = (width + DEPTH_BLOCK_SIZE - 1) >> DEPTH_BLOCK_BITS;
+    blocksY = (height + DEPTH_BLOCK_SIZE - 1) >> DEPTH_BLOCK_BITS;
+    blockMin = new float[blocksX * blocksY];
+    blockStale = new uint8_t[blocksX * blocksY];
+    clearTilesX = (width + CLEAR_TILE_SIZE - 1) >> CLEAR_TILE_BITS;
+    clearTilesY = (height + CLEAR_TILE_SIZE - 1) >> CLEAR_TILE_BITS;
+    tileClear = new uint8_t[clearTilesX * clearTilesY];
+    tileColour = new uint32_t[clearTilesX * clearTilesY];
+  }
+
+  void release()
+  {
+    free(pixels);
+    free(depth);
+    delete[] blockMin;
+    delete[] blockStale;
+    delete[] tileClear;
+    delete[] tileColour;
+  }
+
+public:
+  FrameBuffer(int width, int height)
+  : width(width)
+  , height(height)
+  {
+    allocate();
+    clear(0);
+  }
+
+  ~FrameBuffer()
+  {
+    release();
+  }
+
+  FrameBuffer(const FrameBuffer&) = delete;
+  FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+  /**
+   * Resets every pixel to a colour and every depth value to infinitely far away.
+   *
+   * @param colour A bitpacked ARGB colour.
+   */
+  void clear(uint32_t colour)
+  {
+    streamFill(pixels, (size_t) width * height, colour);
+    clearDepth();
+    std::fill(tileClear, tileClear + clearTilesX * clearTilesY, 1);
+    std::fill(tileColour, tileColour + clearTilesX * clearTilesY, colour);
+  }
+
+  void clearDepth()
+  {
+    streamFill(depth, (size_t) width * height, 0.0f);
+    forgetBlocks();
+    markDirty();
+  }
+
+  /**
+   * Drops every block's bound back to infinitely far away. Anything that
+   * writes depth other than nearer, such as copying in a whole new depth
+   * buffer, must call this so the blocks stay safe.
+   */
+  void forgetBlocks()
+  {
+    std::fill(blockMin, blockMin + blocksX * blocksY, 0.0f);
+    std::fill(blockStale, blockStale + blocksX * blocksY, 0);
+  }
+
+  /**
+   * Changes the size of the buffer, which is then cleared to black.
+   * Nothing is reallocated if the size is unchanged.
+   *
+   * @param newWidth The new width in pixels.
+   * @param newHeight The new height in pixels.
+   */
+  void resize(int newWidth, int newHeight)
+  {
+    if (newWidth == width && newHeight == height) return;
+    release();
+    width = newWidth;
+    height = newHeight;
+    allocate();
+    clear(0);
+  }
+
+  /**
+   * Marks every clear tile as written to, so none of them is skipped by the next clearTiles().
+   */
+  void markDirty()
+  {
+    std::fill(tileClear, tileClear + clearTilesX * clearTilesY, 0);
+  }
+
+  /**
+   * Marks the clear tiles a rectangle overlaps as written to. The rectangle may reach outside the frame.
+   * Tiles already marked are only read, so jobs on different threads may
+   * mark rectangles sharing a tile once that tile has been marked up front.
+   *
+   * @param x0 The leftmost column.
+   * @param y0 The top row.
+   * @param x1 The rightmost column.
+   * @param y1 The bottom row.
+   */
+  void markDirty(int x0, int y0, int x1, int y1)
+  {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, width - 1);
+    y1 = std::min(y1, height - 1);
+    for (int ty = y0 >> CLEAR_TILE_BITS; ty <= y1 >> CLEAR_TILE_BITS && y0 <= y1; ++ty)
+    {
+      for (int tx = x0 >> CLEAR_TILE_BITS; tx <= x1 >> CLEAR_TILE_BITS && x0 <= x1; ++tx)
+      {
+        uint8_t& clear = tileClear[tx + clearTilesX * ty];
+        if (clear) clear = 0;
+      }
+    }
+  }
+
+  /**
+   * Clears a rectangle of colour and depth, along with the depth blocks it
+   * touches, and marks it as written to, since it is about to be drawn over.
+   *
+   * @param x0 The leftmost column.
+   * @param y0 The top row.
+   * @param x1 The rightmost column.
+   * @param y1 The bottom row.
+   * @param colour A bitpacked ARGB colour.
+   */
+  void clearRect(int x0, int y0, int x1, int y1, uint32_t colour)
+  {
+    for (int y = y0; y <= y1; ++y)
+    {
+      std::fill(pixels + y * width + x0, pixels + y * width + x1 + 1, colour);
+      std::fill(depth + y * width + x0, depth + y * width + x1 + 1, 0.0f);
+    }
+
+    for (int by = y0 >> DEPTH_BLOCK_BITS; by <= y1 >> DEPTH_BLOCK_BITS; ++by)
+    {
+      int first = blocksX * by + (x0 >> DEPTH_BLOCK_BITS);
+      int last = blocksX * by + (x1 >> DEPTH_BLOCK_BITS);
+      std::fill(blockMin + first, blockMin + last + 1, 0.0f);
+      std::fill(blockStale + first, blockStale + last + 1, 0);
+    }
+    markDirty(x0, y0, x1, y1);
+  }
+
+  /**
+   * Clears a rectangle like clearRect, except that whole clear tiles inside
+   * it which are still clear to the colour are skipped, and whole tiles it
+   * clears are remembered as clear. Jobs on different threads may clear
+   * different tiles at once.
+   *
+   * @param x0 The leftmost column.
+   * @param y0 The top row.
+   * @param x1 The rightmost column.
+   * @param y1 The bottom row.
+   * @param colour A bitpacked ARGB colour.
+   */
+  void clearTiles(int x0, int y0, int x1, int y1, uint32_t colour)
+  {
+    for (int ty = y0 >> CLEAR_TILE_BITS; ty <= y1 >> CLEAR_TILE_BITS; ++ty)
+    {
+      for (int tx = x0 >> CLEAR_TILE_BITS; tx <= x1 >> CLEAR_TILE_BITS; ++tx)
+      {
+        int tileX0 = tx << CLEAR_TILE_BITS, tileY0 = ty << CLEAR_TILE_BITS;
+        int tileX1 = std::min(tileX0 + CLEAR_TILE_SIZE, width) - 1, tileY1 = std::min(tileY0 + CLEAR_TILE_SIZE, height) - 1;
+        int cx0 = std::max(x0, tileX0), cy0 = std::max(y0, tileY0);
+        int cx1 = std::min(x1, tileX1), cy1 = std::min(y1, tileY1);
+        bool whole = cx0 == tileX0 && cy0 == tileY0 && cx1 == tileX1 && cy1 == tileY1;
+
+        int tile = tx + clearTilesX * ty;
+        if (whole && tileClear[tile] && tileColour[tile] == colour) continue;
+        clearRect(cx0, cy0, cx1, cy1, colour);
+        if (whole)
+        {
+          tileClear[tile] = 1;
+          tileColour[tile] = colour;
+        }
+      }
+    }
+  }
+
+  /**
+   * Recomputes the farthest depth in a block from the depth buffer.
+   *
+   * @param bx The block's column.
+   * @param by The block's row.
+   */
+  void refreshBlock(int bx, int by)
+  {
+    int x0 = bx << DEPTH_BLOCK_BITS, y0 = by << DEPTH_BLOCK_BITS;
+    int x1 = std::min(x0 + DEPTH_BLOCK_SIZE, width), y1 = std::min(y0 + DEPTH_BLOCK_SIZE, height);
+
+#if defined(__SSE2__) && DEPTH_BLOCK_SIZE == 8
+    if (x1 - x0 == DEPTH_BLOCK_SIZE)
+    {
+      __m128 left = _mm_loadu_ps(depth + y0 * width + x0);
+      __m128 right = _mm_loadu_ps(depth + y0 * width + x0 + 4);
+      for (int y = y0 + 1; y < y1; ++y)
+      {
+        left = _mm_min_ps(left, _mm_loadu_ps(depth + y * width + x0));
+        right = _mm_min_ps(right, _mm_loadu_ps(depth + y * width + x0 + 4));
+      }
+      __m128 lanes = _mm_min_ps(left, right);
+      lanes = _mm_min_ps(lanes, _mm_shuffle_ps(lanes, lanes, _MM_SHUFFLE(1, 0, 3, 2)));
+      lanes = _mm_min_ps(lanes, _mm_shuffle_ps(lanes, lanes, _MM_SHUFFLE(2, 3, 0, 1)));
+      blockMin[bx + blocksX * by] = _mm_cvtss_f32(lanes);
+      blockStale[bx + blocksX * by] = 0;
+      return;
+    }
+#endif
+
+    float lowest = depth[y0 * width + x0];
+    for (int y = y0; y < y1; ++y)
+    {
+      for (int x = x0; x < x1; ++x) lowest = std::min(lowest, depth[y * width + x]);
+    }
+    blockMin[bx + blocksX * by] = lowest;
+    blockStale[bx + blocksX * by] = 0;
+  }
+
+  /**
+   * @return The number of pixels anything has been drawn to since the depth was cleared.
+   */
+  int coveredPixels() const
+  {
+    return width * height - std::count(depth, depth + width * height, 0.0f);
+  }
+
+  void setPixel(int x, int y, uint32_t colour)
+  {
+    pixels[x + width * y] = colour;
+    tileClear[(x >> CLEAR_TILE_BITS) + clearTilesX * (y >> CLEAR_TILE_BITS)] = 0;
+  }
+
+  uint32_t getPixel(int x, int y) const
+  {
+    return pixels[x + width * y];
+  }
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "FrameBuffer.h"
+#include "Profiler.h"
+#include "RenderTarget.h"
+
+/**
+ * Presents finished frames to a render target on a thread of its own, so
+ * the next frame can be drawn while the last one is copied out or written
+ * to disk.
+ *
+ * One frame is presented at a time. The caller draws into one frame
+ * buffer while the presenter reads the other, and waits for the presenter
+ * before handing it another frame, so neither buffer is ever read and
+ * written at once.
+ */
+class FramePresenter
+{
+private:
+  RenderTarget& target;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  const FrameBuffer* pending;
+  bool stopping;
+
+  void run()
+  {
+    while (true)
+    {
+      const FrameBuffer* frame;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return stopping || pending != NULL; });
+        if (pending == NULL) return;
+        frame = pending;
+      }
+
+      {
+        PROFILE_SCOPE(STAGE_PRESENT);
+        target.present(*frame);
+      }
+
+      std::unique_lock<std::mutex> lock(mutex);
+      pending = NULL;
+      done.notify_all();
+    }
+  }
+
+public:
+  /**
+   * @param target Where frames are presented. It must outlive the presenter.
+   */
+  FramePresenter(RenderTarget& target)
+  : target(target)
+  , pending(NULL)
+  , stopping(false)
+  {
+    thread = std::thread(&FramePresenter::run, this);
+  }
+
+  /**
+   * Finishes presenting the frame in hand, if any, then stops the thread.
+   */
+  ~FramePresenter()
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+  }
+
+  FramePresenter(const FramePresenter&) = delete;
+  FramePresenter& operator=(const FramePresenter&) = delete;
+
+  /**
+   * Starts presenting a frame, after waiting for the one before to finish.
+   *
+   * @param frame The frame, which must not be drawn into until the next wait() or submit() returns.
+   */
+  void submit(const FrameBuffer& frame)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return pending == NULL; });
+    pending = &frame;
+    wake.notify_all();
+  }
+
+  /**
+   * Waits until the frame last submitted has been presented.
+   */
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return pending == NULL; });
+  }
+};
@@ -1,112 +1,111 @@
 #pragma once
 
-#include <fstream>
-#include "PixelUtil.h"
+#include <inttypes.h>
+#include <cstddef>
+#include <vector>
 
+/**
+ * A packed ARGB image, row-major.
+ *
+ * An image either owns its pixels, in which case copies are deep, or is a
+ * view over memory that belongs to someone else, such as a mapped scene
+ * cache, in which case copies share that memory.
+ */
 class Image
 {
 private:
   int width, height;
+  std::vector<uint32_t> storage;
   uint32_t* payload;
 
 public:
-  Image() {}
+  Image()
+  : width(0)
+  , height(0)
+  , payload(NULL)
+  {}
+
+  /**
+   * Allocates an image that owns its pixels.
+   */
+  Image(int width, int height)
+  : width(width)
+  , height(height)
+  , storage((size_t) width * height)
+  , payload(storage.data())
+  {}
 
+  /**
+   * Wraps pixels owned elsewhere, which must outlive the image.
+   */
   Image(int width, int height, uint32_t* payload)
   : width(width)
   , height(height)
   , payload(payload)
   {}
 
-  uint32_t GetPixel(int x, int y) const
+  Image(const Image& other)
+  : width(other.width)
+  , height(other.height)
+  , storage(other.storage)
+  , payload(other.ownsPayload() ? storage.data() : other.payload)
+  {}
+
+  Image(Image&& other)
+  : width(other.width)
+  , height(other.height)
+  , payload(other.payload)
   {
-    int i = y * width + x;
-    return payload[i];
+    bool owned = other.ownsPayload();
+    storage.swap(other.storage);
+    if (owned) payload = storage.data();
+    other.width = other.height = 0;
+    other.payload = NULL;
   }
 
-  int getWidth() const
+  Image& operator=(Image other)
   {
-    return width;
+    bool owned = other.ownsPayload();
+    width = other.width;
+    height = other.height;
+    storage.swap(other.storage);
+    payload = owned ? storage.data() : other.payload;
+    return *this;
   }
 
-  int getHeight() const
+  bool ownsPayload() const
   {
-    return height;
+    return !storage.empty() && payload == storage.data();
   }
-};
 
-int readNumber(FILE *fptr)
-{
-  char buffer[8]; 
-  if (!fscanf(fptr, "%s\n", buffer)) return EXIT_FAILURE;
-  return atoi(buffer);
-}
-
-/**
- * Loads a PPM file.
- *
- * @param filename The location of the ppm file.
- * @return An image container, containing the payload and size of the image.
- */
-Image loadPPM(const char* fileName)
-{
-  FILE *fptr;
-  int retval;
-
-  Image image;
-  int imageSize;
-
-  if ((fptr = fopen(fileName,"r")) == NULL){
-      printf("Error! opening file");
-      exit(1);
+  bool isEmpty() const
+  {
+    return payload == NULL || width <= 0 || height <= 0;
   }
 
-  // Read magic no.
-  retval = fscanf(fptr, "%*[^\n]\n");
-
-  //printf("str: %s\n", buf);
-
-  // Read Space
-  retval = fscanf(fptr, " ");
-
-  // Read comment
-  char c = (char) getc(fptr);
-  if (c == '#') retval = fscanf(fptr, "%*[^\n]\n");
-
-  // Read width
-  int width = readNumber(fptr);
-
-  // Whitespace
-  retval = fscanf(fptr, " ");
-
-  // Read width
-  int height = readNumber(fptr);
-
-  // Whitespace
-  retval = fscanf(fptr, " ");
-
-  // Read width
-  int maxval = readNumber(fptr);
-
-  if (retval) exit(EXIT_FAILURE);
-  if (!maxval) exit(EXIT_FAILURE);
-
-  // Copy payload
-  imageSize = width * height;
-  uint32_t* payload = (uint32_t*) malloc(imageSize * sizeof(uint32_t));
-
-  for (int i = 0; i < imageSize; ++i)
+  uint32_t GetPixel(int x, int y) const
   {
-    int r = (int) getc(fptr);
-    int g = (int) getc(fptr);
-    int b = (int) getc(fptr);
+    int i = y * width + x;
+    return payload[i];
+  }
 
-    uint32_t colour = packRGB(r,g,b); 
-    payload[i] = colour;
+  const uint32_t* getPayload() const
+  {
+    return payload;
   }
 
-  fclose(fptr);
+  uint32_t* getPayload()
+  {
+    return payload;
+  }
 
-  return Image(width, height, payload);
-}
+  int getWidth() const
+  {
+    return width;
+  }
 
+  int getHeight() const
+  {
+    return height;
+  }
+};
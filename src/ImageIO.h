@@ -0,0 +1,414 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <inttypes.h>
+#include <utility>
+#include <vector>
+#include "Image.h"
+#include "MappedFile.h"
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The most pixels an image file may have, 1 GB of ARGB, whatever its header claims.
+#define IMAGE_MAX_PIXELS ((size_t) 1 << 28)
+
+/**
+ * The header of a Netpbm file: P3 (ASCII RGB), P5 (grey), P6 (RGB) or P7 (PAM).
+ */
+struct PNMHeader
+{
+  char format;
+  int width, height;
+  int channels; // 1 grey, 2 grey and alpha, 3 RGB, 4 RGB and alpha.
+  int maxval;
+  size_t dataOffset;
+};
+
+inline bool isPNMSpace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/**
+ * Skips whitespace and # comments between header fields.
+ */
+inline void skipPNMSpace(const char*& p, const char* end)
+{
+  while (p < end)
+  {
+    if (*p == '#')
+    {
+      while (p < end && *p != '\n') ++p;
+    }
+    else if (isPNMSpace(*p))
+    {
+      ++p;
+    }
+    else
+    {
+      break;
+    }
+  }
+}
+
+/**
+ * Reads a non-negative decimal number, skipping any whitespace and comments before it.
+ *
+ * @return False if there is no number or it does not fit in an int.
+ */
+inline bool parsePNMNumber(const char*& p, const char* end, int& value)
+{
+  skipPNMSpace(p, end);
+  if (p >= end || *p < '0' || *p > '9') return false;
+
+  long long n = 0;
+  while (p < end && *p >= '0' && *p <= '9')
+  {
+    n = n * 10 + (*p++ - '0');
+    if (n > INT_MAX) return false;
+  }
+  value = (int) n;
+  return true;
+}
+
+/**
+ * Reads the header of a PAM file, which lists its fields by name up to ENDHDR.
+ */
+inline bool readPAMHeader(const char*& p, const char* end, PNMHeader& header)
+{
+  header.width = header.height = header.channels = header.maxval = -1;
+  while (true)
+  {
+    skipPNMSpace(p, end);
+    const char* word = p;
+    while (p < end && !isPNMSpace(*p)) ++p;
+    size_t length = p - word;
+    if (length == 0) return false;
+
+    if (length == 6 && memcmp(word, "ENDHDR", 6) == 0)
+    {
+      while (p < end && *p != '\n') ++p;
+      if (p < end) ++p;
+      return header.width > 0 && header.height > 0 && header.channels >= 1 && header.channels <= 4;
+    }
+    else if (length == 5 && memcmp(word, "WIDTH", 5) == 0)
+    {
+      if (!parsePNMNumber(p, end, header.width)) return false;
+    }
+    else if (length == 6 && memcmp(word, "HEIGHT", 6) == 0)
+    {
+      if (!parsePNMNumber(p, end, header.height)) return false;
+    }
+    else if (length == 5 && memcmp(word, "DEPTH", 5) == 0)
+    {
+      if (!parsePNMNumber(p, end, header.channels)) return false;
+    }
+    else if (length == 6 && memcmp(word, "MAXVAL", 6) == 0)
+    {
+      if (!parsePNMNumber(p, end, header.maxval)) return false;
+    }
+    else
+    {
+      // TUPLTYPE and anything unknown; DEPTH already says how to read the samples.
+      while (p < end && *p != '\n') ++p;
+    }
+  }
+}
+
+/**
+ * Reads the header of a Netpbm file.
+ *
+ * @param begin The start of the file.
+ * @param end The end of the file.
+ * @param header Receives the header, including where the samples start.
+ * @return False if the file is not a supported, well formed Netpbm file.
+ */
+bool readPNMHeader(const char* begin, const char* end, PNMHeader& header)
+{
+  const char* p = begin;
+  if (end - p < 2 || p[0] != 'P') return false;
+  header.format = p[1];
+  p += 2;
+
+  if (header.format == '7')
+  {
+    if (!readPAMHeader(p, end, header)) return false;
+  }
+  else if (header.format == '3' || header.format == '5' || header.format == '6')
+  {
+    header.channels = header.format == '5' ? 1 : 3;
+    if (!parsePNMNumber(p, end, header.width) || !parsePNMNumber(p, end, header.height)) return false;
+    if (!parsePNMNumber(p, end, header.maxval)) return false;
+
+    // A single whitespace character separates the header from binary samples.
+    if (p >= end || !isPNMSpace(*p)) return false;
+    ++p;
+  }
+  else
+  {
+    return false;
+  }
+
+  if (header.width <= 0 || header.height <= 0 || header.maxval < 1 || header.maxval > 65535) return false;
+  header.dataOffset = p - begin;
+  return true;
+}
+
+/**
+ * Expands 8-bit RGB triples to packed opaque ARGB.
+ */
+void expandRGB8(const uint8_t* src, uint32_t* dst, size_t count)
+{
+  size_t i = 0;
+
+#if defined(__SSSE3__)
+  // Four pixels per shuffle. Each load reads 16 bytes, so stop while 6 pixels remain.
+  const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+  const __m128i alpha = _mm_set1_epi32((int) 0xFF000000);
+  for (; i + 6 <= count; i += 4)
+  {
+    __m128i rgb = _mm_loadu_si128((const __m128i*) (src + 3 * i));
+    _mm_storeu_si128((__m128i*) (dst + i), _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha));
+  }
+#endif
+
+  for (; i < count; ++i)
+  {
+    const uint8_t* s = src + 3 * i;
+    dst[i] = 0xFF000000u | ((uint32_t) s[0] << 16) | ((uint32_t) s[1] << 8) | s[2];
+  }
+}
+
+/**
+ * Expands 8-bit grey samples to packed opaque ARGB.
+ */
+void expandGrey8(const uint8_t* src, uint32_t* dst, size_t count)
+{
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  const __m128i alpha = _mm_set1_epi32((int) 0xFF000000);
+  for (; i + 16 <= count; i += 16)
+  {
+    __m128i grey = _mm_loadu_si128((const __m128i*) (src + i));
+    __m128i low = _mm_unpacklo_epi8(grey, grey);
+    __m128i high = _mm_unpackhi_epi8(grey, grey);
+    _mm_storeu_si128((__m128i*) (dst + i), _mm_or_si128(_mm_unpacklo_epi16(low, low), alpha));
+    _mm_storeu_si128((__m128i*) (dst + i + 4), _mm_or_si128(_mm_unpackhi_epi16(low, low), alpha));
+    _mm_storeu_si128((__m128i*) (dst + i + 8), _mm_or_si128(_mm_unpacklo_epi16(high, high), alpha));
+    _mm_storeu_si128((__m128i*) (dst + i + 12), _mm_or_si128(_mm_unpackhi_epi16(high, high), alpha));
+  }
+#endif
+
+  for (; i < count; ++i)
+  {
+    dst[i] = 0xFF000000u | 0x010101u * src[i];
+  }
+}
+
+/**
+ * Packs ARGB pixels into 8-bit RGB triples. dst must have 4 bytes of slack
+ * past the last triple, since each vector store writes 16 bytes.
+ */
+void packRGB8(const uint32_t* src, uint8_t* dst, size_t count)
+{
+  size_t i = 0;
+
+#if defined(__SSSE3__)
+  const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128i argb = _mm_loadu_si128((const __m128i*) (src + i));
+    _mm_storeu_si128((__m128i*) (dst + 3 * i), _mm_shuffle_epi8(argb, shuffle));
+  }
+#endif
+
+  for (; i < count; ++i)
+  {
+    uint32_t colour = src[i];
+    dst[3 * i + 0] = (colour >> 16) & 0xFF;
+    dst[3 * i + 1] = (colour >> 8) & 0xFF;
+    dst[3 * i + 2] = colour & 0xFF;
+  }
+}
+
+/**
+ * Converts the samples of any supported file to packed ARGB: ASCII samples,
+ * maxvals other than 255, 16-bit samples and alpha channels.
+ *
+ * @return False if the file ends before every sample has been read.
+ */
+bool decodePNMSamples(const PNMHeader& header, const char* p, const char* end, uint32_t* dst)
+{
+  size_t count = (size_t) header.width * header.height;
+  int maxval = header.maxval;
+  bool wide = maxval > 255;
+  bool ascii = header.format == '3';
+
+  // Rescale to 0-255 through a table for 8-bit files, and arithmetic for 16-bit ones.
+  uint8_t table[256];
+  if (!wide)
+  {
+    for (int v = 0; v <= maxval; ++v) table[v] = (uint8_t) ((v * 255 + maxval / 2) / maxval);
+  }
+
+  size_t sampleSize = wide ? 2 : 1;
+  if (!ascii && (size_t) (end - p) < count * header.channels * sampleSize) return false;
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    uint32_t channel[4] = {0, 0, 0, 255};
+    for (int c = 0; c < header.channels; ++c)
+    {
+      int value;
+      if (ascii)
+      {
+        if (!parsePNMNumber(p, end, value)) return false;
+      }
+      else if (wide)
+      {
+        value = ((uint8_t) p[0] << 8) | (uint8_t) p[1];
+        p += 2;
+      }
+      else
+      {
+        value = (uint8_t) *p++;
+      }
+
+      value = std::min(value, maxval);
+      channel[c] = wide ? (uint32_t) ((value * 255 + maxval / 2) / maxval) : table[value];
+    }
+
+    // Grey, with or without alpha, fills all three colour channels.
+    if (header.channels <= 2)
+    {
+      channel[3] = header.channels == 2 ? channel[1] : 255;
+      channel[1] = channel[2] = channel[0];
+    }
+    dst[i] = (channel[3] << 24) | (channel[0] << 16) | (channel[1] << 8) | channel[2];
+  }
+  return true;
+}
+
+/**
+ * Loads a Netpbm image: P3, P5 or P6, or a PAM with 1 to 4 channels, with
+ * 8 or 16-bit samples. The file is memory-mapped and 8-bit RGB and grey
+ * payloads are expanded in bulk.
+ *
+ * @param fileName The location of the image file.
+ * @param image Receives the image, which owns its pixels.
+ * @return Whether the image was loaded. Reasons for failure are printed to cerr.
+ */
+bool loadImage(const char* fileName, Image& image)
+{
+  MappedFile file(fileName);
+  if (!file.isOpen())
+  {
+    std::cerr << "Error! opening file " << fileName << std::endl;
+    return false;
+  }
+
+  PNMHeader header;
+  if (!readPNMHeader(file.begin(), file.end(), header))
+  {
+    std::cerr << "Error! " << fileName << " is not a supported PPM, PGM or PAM image" << std::endl;
+    return false;
+  }
+
+  // The header is checked against the payload actually there before anything is allocated for it.
+  // ASCII samples take at least a digit and a separator each, bar the last.
+  size_t count = (size_t) header.width * header.height;
+  const char* data = file.begin() + header.dataOffset;
+  size_t available = file.end() - data;
+  size_t samples = count * header.channels;
+  size_t needed = header.format == '3' ? 2 * samples - 1 : samples * (header.maxval > 255 ? 2 : 1);
+  if (count > IMAGE_MAX_PIXELS)
+  {
+    std::cerr << "Error! " << fileName << " is " << header.width << "x" << header.height << ", too large to load" << std::endl;
+    return false;
+  }
+  if (available < needed)
+  {
+    std::cerr << "Error! " << fileName << " is truncated" << std::endl;
+    return false;
+  }
+
+  Image loaded(header.width, header.height);
+  bool ok;
+
+  if (header.format != '3' && header.maxval == 255 && header.channels == 3)
+  {
+    expandRGB8((const uint8_t*) data, loaded.getPayload(), count);
+    ok = true;
+  }
+  else if (header.format != '3' && header.maxval == 255 && header.channels == 1)
+  {
+    expandGrey8((const uint8_t*) data, loaded.getPayload(), count);
+    ok = true;
+  }
+  else
+  {
+    ok = decodePNMSamples(header, data, file.end(), loaded.getPayload());
+  }
+
+  if (!ok)
+  {
+    std::cerr << "Error! " << fileName << " is truncated" << std::endl;
+    return false;
+  }
+
+  image = std::move(loaded);
+  return true;
+}
+
+/**
+ * Loads a PPM file.
+ *
+ * @param fileName The location of the ppm file.
+ * @return An image that owns its pixels, or an empty image if it could not be loaded.
+ */
+Image loadPPM(const char* fileName)
+{
+  Image image;
+  loadImage(fileName, image);
+  return image;
+}
+
+/**
+ * Saves a packed ARGB buffer as a binary PPM file, with a single write.
+ *
+ * @param fileName The location of the ppm file.
+ * @param payload The packed ARGB pixels, row-major.
+ * @param width The width of the image.
+ * @param height The height of the image.
+ * @return Whether the file was written.
+ */
+bool savePPM(const char* fileName, const uint32_t* payload, int width, int height)
+{
+  char header[64];
+  int headerSize = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+  size_t count = (size_t) width * height;
+
+  std::vector<uint8_t> buffer(headerSize + count * 3 + 4);
+  memcpy(buffer.data(), header, headerSize);
+  packRGB8(payload, buffer.data() + headerSize, count);
+
+  FILE* fptr = fopen(fileName, "wb");
+  if (fptr == NULL) return false;
+  size_t size = headerSize + count * 3;
+  bool ok = fwrite(buffer.data(), 1, size, fptr) == size;
+  return fclose(fptr) == 0 && ok;
+}
+
+bool savePPM(const char* fileName, const Image& image)
+{
+  return savePPM(fileName, image.getPayload(), image.getWidth(), image.getHeight());
+}
@@ -1,54 +1,249 @@
 #pragma once
 
-#include <vector>
+#include <inttypes.h>
+#include <cmath>
 #include <glm/glm.hpp>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 using namespace glm;
 
+// Fixed point interpolants carry this many fractional bits.
+#define INTERPOLATION_FIXED_BITS 16
+#define INTERPOLATION_FIXED_ONE (1 << INTERPOLATION_FIXED_BITS)
+
 /**
- * Interpolates between two floating point numbers
+ * The step between neighbouring values when interpolating a number of
+ * values from one point to another, both inclusive. A single value, or
+ * none, takes no step, so short edges never divide by zero.
  *
  * @param from The starting point.
  * @param to The ending point.
- * @param numValues The number of values to obtain beteen the starting and ending points.
- * @return A vector containing the interpolated values
+ * @param numValues The number of values.
+ * @return The step.
  */
-std::vector<float> interpolate(float from, float to, float numValues)
+inline float interpolationStep(float from, float to, int numValues)
 {
-  std::vector<float> values;
+  return numValues > 1 ? (to - from) / (numValues - 1) : 0.0f;
+}
 
-  float incr = (to - from) / (numValues - 1.0f);
+/**
+ * Writes a run of interpolated values one at a time. Used for the tail of
+ * a batch that does not fill a SIMD register.
+ *
+ * @param from The first value.
+ * @param step The step between neighbouring values.
+ * @param begin The index of the first value to write.
+ * @param end One past the index of the last value to write.
+ * @param values Receives values[begin] to values[end - 1].
+ */
+inline void interpolateScalar(float from, float step, int begin, int end, float* values)
+{
+  for (int i = begin; i < end; ++i) values[i] = from + step * i;
+}
 
-  float acc = from;
-  for (float i = 0; i <= numValues; ++i)
+/**
+ * Interpolates between two floating point numbers into caller provided storage.
+ *
+ * @param from The starting point, which is the first value.
+ * @param to The ending point, which is the last value.
+ * @param numValues The number of values to obtain between the starting and ending points.
+ * @param values Receives numValues values.
+ */
+void interpolate(float from, float to, int numValues, float* values)
+{
+  float step = interpolationStep(from, to, numValues);
+  int i = 0;
+
+#if defined(__SSE2__)
+  // Each value is computed from its index rather than accumulated, so batches do not drift.
+  __m128 start = _mm_set1_ps(from);
+  __m128 steps = _mm_set1_ps(step);
+  __m128 index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+  __m128 four = _mm_set1_ps(4.0f);
+  for (; i + 4 <= numValues; i += 4)
   {
-    values.push_back(acc);
-    acc += incr;
+    _mm_storeu_ps(values + i, _mm_add_ps(start, _mm_mul_ps(steps, index)));
+    index = _mm_add_ps(index, four);
   }
+#endif
 
-  return values;
+  interpolateScalar(from, step, i, numValues, values);
 }
 
 /**
- * Interpolates between two 3D vectors.
+ * Interpolates between two 3D vectors into caller provided storage, one
+ * stream per component.
  *
- * @param from The starting point.
- * @param to The ending point.
- * @param numValues The number of values to obtain beteen the starting and ending points.
- * @return A vector containing the interpolated values
+ * @param from The starting point, which is the first value.
+ * @param to The ending point, which is the last value.
+ * @param numValues The number of values to obtain between the starting and ending points.
+ * @param x Receives the numValues x components.
+ * @param y Receives the numValues y components.
+ * @param z Receives the numValues z components.
+ */
+void interpolate(const vec3& from, const vec3& to, int numValues, float* x, float* y, float* z)
+{
+  interpolate(from.x, to.x, numValues, x);
+  interpolate(from.y, to.y, numValues, y);
+  interpolate(from.z, to.z, numValues, z);
+}
+
+/**
+ * Interpolates between two 3D vectors into caller provided storage.
+ *
+ * @param from The starting point, which is the first value.
+ * @param to The ending point, which is the last value.
+ * @param numValues The number of values to obtain between the starting and ending points.
+ * @param values Receives numValues values.
  */
-std::vector<vec3> interpolate(const vec3& from, const vec3& to, float numValues)
+void interpolate(const vec3& from, const vec3& to, int numValues, vec3* values)
 {
-  std::vector<vec3> values;
-  
-  vec3 incr = (to - from) / (vec3(numValues - 1.0f));
+  vec3 step = numValues > 1 ? (to - from) / vec3((float) (numValues - 1)) : vec3(0.0f);
+  for (int i = 0; i < numValues; ++i) values[i] = from + step * (float) i;
+}
 
-  vec3 acc = from;
-  for (float i = 0; i <= numValues; ++i)
+/**
+ * Streams values interpolated between two points one at a time, without
+ * storing them, for loops that use each value once:
+ *
+ *   for (Interpolator<float> x(from, to, rows); !x.done(); ++x) use(*x);
+ *
+ * Works for float and vec3.
+ */
+template <typename T>
+class Interpolator
+{
+private:
+  T value;
+  T step;
+  int remaining;
+
+public:
+  /**
+   * @param from The starting point, which is the first value.
+   * @param to The ending point, which is the last value.
+   * @param numValues The number of values to step through.
+   */
+  Interpolator(const T& from, const T& to, int numValues)
+  : value(from)
+  , step(numValues > 1 ? (to - from) / T((float) (numValues - 1)) : T(0.0f))
+  , remaining(numValues > 0 ? numValues : 0)
+  {}
+
+  /**
+   * @return True once every value has been stepped past. Stepping further carries on along the same line.
+   */
+  bool done() const
+  {
+    return remaining <= 0;
+  }
+
+  const T& operator*() const
   {
-    values.push_back(acc);
-    acc += incr;
+    return value;
   }
 
-  return values;
-}
\ No newline at end of file
+  Interpolator& operator++()
+  {
+    value += step;
+    --remaining;
+    return *this;
+  }
+};
+
+/**
+ * A digital differential analyser: streams numbers interpolated between
+ * two points in 16.16 fixed point, stepping with integer adds alone. For
+ * pixel coordinates and colour channels, which are within +/-32767.
+ */
+class FixedInterpolator
+{
+private:
+  int32_t value;
+  int32_t step;
+  int remaining;
+
+public:
+  /**
+   * @param from The starting point, which is the first value.
+   * @param to The ending point, which is the last value.
+   * @param numValues The number of values to step through.
+   */
+  FixedInterpolator(float from, float to, int numValues)
+  : value((int32_t) std::lround(from * INTERPOLATION_FIXED_ONE))
+  , step((int32_t) std::lround(interpolationStep(from, to, numValues) * INTERPOLATION_FIXED_ONE))
+  , remaining(numValues > 0 ? numValues : 0)
+  {}
+
+  bool done() const
+  {
+    return remaining <= 0;
+  }
+
+  /**
+   * @return The current value in 16.16 fixed point.
+   */
+  int32_t fixed() const
+  {
+    return value;
+  }
+
+  /**
+   * @return The current value rounded to the nearest integer.
+   */
+  int rounded() const
+  {
+    return (value + INTERPOLATION_FIXED_ONE / 2) >> INTERPOLATION_FIXED_BITS;
+  }
+
+  FixedInterpolator& operator++()
+  {
+    value += step;
+    --remaining;
+    return *this;
+  }
+};
+
+/**
+ * Writes a run of fixed point values one at a time, the tail of interpolateFixed.
+ *
+ * @param start The first value, in 16.16 fixed point.
+ * @param step The step between neighbouring values, in 16.16 fixed point.
+ * @param begin The index of the first value to write.
+ * @param end One past the index of the last value to write.
+ * @param values Receives values[begin] to values[end - 1].
+ */
+inline void interpolateFixedScalar(int32_t start, int32_t step, int begin, int end, int32_t* values)
+{
+  for (int i = begin; i < end; ++i) values[i] = start + step * i;
+}
+
+/**
+ * Interpolates between two numbers in 16.16 fixed point into caller provided storage.
+ *
+ * @param from The starting point, which is the first value.
+ * @param to The ending point, which is the last value.
+ * @param numValues The number of values to obtain between the starting and ending points.
+ * @param values Receives numValues values, in 16.16 fixed point.
+ */
+void interpolateFixed(float from, float to, int numValues, int32_t* values)
+{
+  int32_t start = (int32_t) std::lround(from * INTERPOLATION_FIXED_ONE);
+  int32_t step = (int32_t) std::lround(interpolationStep(from, to, numValues) * INTERPOLATION_FIXED_ONE);
+  int i = 0;
+
+#if defined(__SSE2__)
+  __m128i value = _mm_setr_epi32(start, start + step, start + 2 * step, start + 3 * step);
+  __m128i advance = _mm_set1_epi32(4 * step);
+  for (; i + 4 <= numValues; i += 4)
+  {
+    _mm_storeu_si128((__m128i*) (values + i), value);
+    value = _mm_add_epi32(value, advance);
+  }
+#endif
+
+  interpolateFixedScalar(start, step, i, numValues, values);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * A read-only view of a whole file, memory-mapped for as long as the object lives.
+ */
+class MappedFile
+{
+private:
+  const char* data;
+  size_t size;
+  bool open;
+
+public:
+  MappedFile(const char* fileName)
+  : data(NULL)
+  , size(0)
+  , open(false)
+  {
+    int fd = ::open(fileName, O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0)
+    {
+      size = info.st_size;
+      if (size == 0)
+      {
+        open = true;
+      }
+      else
+      {
+        void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+          madvise(mapping, size, MADV_SEQUENTIAL);
+          data = (const char*) mapping;
+          open = true;
+        }
+      }
+    }
+
+    close(fd);
+  }
+
+  ~MappedFile()
+  {
+    if (data != NULL) munmap((void*) data, size);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool isOpen() const
+  {
+    return open;
+  }
+
+  const char* begin() const
+  {
+    return data;
+  }
+
+  const char* end() const
+  {
+    return data + size;
+  }
+
+  size_t getSize() const
+  {
+    return size;
+  }
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <inttypes.h>
+#include <glm/glm.hpp>
+#include "Bounds.h"
+#include "PixelUtil.h"
+#include "VertexStage.h"
+
+// Set in a material's flags when its diffuse colour comes from a texture.
+#define MATERIAL_TEXTURED 0x1u
+
+/**
+ * Material names, packed colours, flags and diffuse texture files,
+ * referenced by index from a Mesh.
+ */
+struct MaterialTable
+{
+    std::vector<std::string> names;
+    std::vector<uint32_t> colours;
+    std::vector<uint32_t> flags;
+    std::vector<std::string> textures;
+
+    int size() const
+    {
+        return names.size();
+    }
+
+    /**
+     * @param name The name of a material.
+     * @return The index of the material, or -1 if there is no material with that name.
+     */
+    int find(const std::string& name) const
+    {
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            if (names[i] == name) return i;
+        }
+        return -1;
+    }
+
+    /**
+     * Adds a material, or replaces the colour of an existing one with the same name.
+     *
+     * @param name The name of the material.
+     * @param colour A bitpacked ARGB colour.
+     * @return The index of the material.
+     */
+    int add(const std::string& name, uint32_t colour)
+    {
+        int i = find(name);
+        if (i >= 0)
+        {
+            colours[i] = colour;
+            return i;
+        }
+        names.push_back(name);
+        colours.push_back(colour);
+        flags.push_back(0);
+        textures.push_back("");
+        return names.size() - 1;
+    }
+
+    /**
+     * Gives a material a diffuse texture.
+     *
+     * @param i The index of the material.
+     * @param fileName The texture file, as named in the material library.
+     */
+    void setTexture(int i, const std::string& fileName)
+    {
+        textures[i] = fileName;
+        flags[i] |= MATERIAL_TEXTURED;
+    }
+};
+
+// Marks a corner that has no texture coordinate or normal.
+#define NO_INDEX 0xFFFFFFFFu
+
+/**
+ * Texture coordinates stored as separate u and v streams.
+ */
+struct TexCoordStream
+{
+    std::vector<float> u, v;
+
+    int size() const
+    {
+        return u.size();
+    }
+
+    void push_back(float s, float t)
+    {
+        u.push_back(s);
+        v.push_back(t);
+    }
+};
+
+/**
+ * A named part of a mesh, covering a contiguous range of its triangles and vertices.
+ */
+struct MeshObject
+{
+    std::string name;
+    uint32_t firstTriangle, triangleCount;
+    uint32_t firstVertex, vertexCount;
+    AABB bounds;
+};
+
+/**
+ * An indexed triangle mesh.
+ *
+ * Positions are shared between triangles and stored as separate x/y/z
+ * streams for the vertex stage. Each triangle is three indices into the
+ * positions plus one index into the material table, so drawing touches no
+ * strings and nothing on the heap beyond these flat arrays.
+ *
+ * Texture coordinates and normals are optional. When present they have
+ * their own index per triangle corner, parallel to indices, holding
+ * NO_INDEX for corners that do not have one.
+ */
+struct Mesh
+{
+    VertexStream positions;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> materialIds;
+    TexCoordStream texCoords;
+    std::vector<uint32_t> texCoordIndices;
+    VertexStream normals;
+    std::vector<uint32_t> normalIndices;
+    MaterialTable materials;
+    std::vector<MeshObject> objects;
+
+    // The first triangle of each object, in order, for views of the mesh.
+    std::vector<uint32_t> objectStarts;
+
+    // The files the mesh was loaded from.
+    std::vector<std::string> sources;
+
+    int triangleCount() const
+    {
+        return materialIds.size();
+    }
+};
+
+/**
+ * The arrays a renderer needs to draw a mesh, wherever they happen to live:
+ * in a Mesh, or directly inside a memory-mapped scene cache.
+ */
+struct MeshView
+{
+    const float* x;
+    const float* y;
+    const float* z;
+    int vertexCount;
+
+    const uint32_t* indices;
+    const uint32_t* materialIds;
+    int triangleCount;
+
+    const uint32_t* colours;
+    const uint32_t* materialFlags;
+    int materialCount;
+
+    // NULL when the mesh has no texture coordinates.
+    const float* u;
+    const float* v;
+    const uint32_t* texCoordIndices;
+    int texCoordCount;
+
+    // The first triangle of each object, in order. Triangles before the first object belong to none.
+    const uint32_t* objectStarts;
+    int objectCount;
+};
+
+/**
+ * @param mesh A loaded mesh, which must outlive the view.
+ * @return A view of the mesh's arrays.
+ */
+MeshView viewOf(const Mesh& mesh)
+{
+    MeshView view;
+    view.x = mesh.positions.x.data();
+    view.y = mesh.positions.y.data();
+    view.z = mesh.positions.z.data();
+    view.vertexCount = mesh.positions.size();
+    view.indices = mesh.indices.data();
+    view.materialIds = mesh.materialIds.data();
+    view.triangleCount = mesh.triangleCount();
+    view.colours = mesh.materials.colours.data();
+    view.materialFlags = mesh.materials.flags.data();
+    view.materialCount = mesh.materials.size();
+
+    bool textured = !mesh.texCoordIndices.empty();
+    view.u = textured ? mesh.texCoords.u.data() : NULL;
+    view.v = textured ? mesh.texCoords.v.data() : NULL;
+    view.texCoordIndices = textured ? mesh.texCoordIndices.data() : NULL;
+    view.texCoordCount = textured ? mesh.texCoords.size() : 0;
+
+    view.objectStarts = mesh.objectStarts.data();
+    view.objectCount = mesh.objectStarts.size();
+    return view;
+}
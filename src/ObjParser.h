@@ -0,0 +1,596 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <inttypes.h>
+#include "MappedFile.h"
+#include "Mesh.h"
+#include "PixelUtil.h"
+#include "ThreadPool.h"
+
+/**
+ * How long a file took to parse.
+ */
+struct ParseStats
+{
+    size_t bytes;
+    double seconds;
+
+    double megabytesPerSecond() const
+    {
+        return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+    }
+};
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/**
+ * Skips spaces and tabs, stopping at the end of the line.
+ */
+inline void skipBlanks(const char*& p, const char* end)
+{
+    while (p < end && isBlank(*p)) ++p;
+}
+
+/**
+ * Moves to the first character of the next line.
+ */
+inline void skipLine(const char*& p, const char* end)
+{
+    const char* newline = (const char*) memchr(p, '\n', end - p);
+    p = newline == NULL ? end : newline + 1;
+}
+
+/**
+ * Whether the line starting at p begins with a keyword followed by whitespace.
+ */
+inline bool startsWith(const char* p, const char* end, const char* keyword, size_t length)
+{
+    return (size_t) (end - p) > length && memcmp(p, keyword, length) == 0 && isBlank(p[length]);
+}
+
+/**
+ * Reads a whitespace delimited token, such as a material or object name.
+ */
+inline std::string parseToken(const char*& p, const char* end)
+{
+    skipBlanks(p, end);
+    const char* start = p;
+    while (p < end && !isBlank(*p) && *p != '\n') ++p;
+    return std::string(start, p);
+}
+
+/**
+ * Parses a signed decimal integer in place.
+ */
+inline long parseInt(const char*& p, const char* end)
+{
+    skipBlanks(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        ++p;
+    }
+
+    long value = 0;
+    while (p < end && isDigit(*p))
+    {
+        value = value * 10 + (*p - '0');
+        ++p;
+    }
+    return negative ? -value : value;
+}
+
+/**
+ * Parses a decimal floating point number, with optional exponent, in place.
+ * Up to 18 significant digits are kept, which is far more than a float holds.
+ */
+inline float parseFloat(const char*& p, const char* end)
+{
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    skipBlanks(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        ++p;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    while (p < end && isDigit(*p))
+    {
+        if (digits < 18)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa != 0) ++digits;
+        }
+        else
+        {
+            ++exponent;
+        }
+        ++p;
+    }
+
+    if (p < end && *p == '.')
+    {
+        ++p;
+        while (p < end && isDigit(*p))
+        {
+            if (digits < 18)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa != 0) ++digits;
+                --exponent;
+            }
+            ++p;
+        }
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        exponent += (int) parseInt(p, end);
+    }
+
+    double value = (double) mantissa;
+    if (exponent < 0)
+    {
+        value = -exponent <= 22 ? value / powers[-exponent] : value * std::pow(10.0, exponent);
+    }
+    else if (exponent > 0)
+    {
+        value = exponent <= 22 ? value * powers[exponent] : value * std::pow(10.0, exponent);
+    }
+    return (float) (negative ? -value : value);
+}
+
+/**
+ * Turns a 1-based or negative (relative to the end) OBJ index into a 0-based index.
+ *
+ * @param index The index as written in the file. 0 means it was left out.
+ * @param count How many elements have been defined so far.
+ * @return The 0-based index, or NO_INDEX if it was left out.
+ */
+inline uint32_t resolveIndex(long index, size_t count)
+{
+    if (index > 0) return index - 1;
+    if (index < 0) return count + index;
+    return NO_INDEX;
+}
+
+/**
+ * Appends a per-corner attribute index, keeping the stream parallel to the
+ * position indices once any corner has the attribute.
+ */
+inline void pushCornerIndex(std::vector<uint32_t>& cornerIndices, size_t corner, uint32_t index)
+{
+    if (index == NO_INDEX && cornerIndices.empty()) return;
+    if (cornerIndices.size() < corner) cornerIndices.resize(corner, NO_INDEX);
+    cornerIndices.push_back(index);
+}
+
+/**
+ * Loads the materials of a .mtl file into a material table.
+ *
+ * @param filepath The location of the .mtl file.
+ * @param materials The table the materials are added to.
+ */
+void loadMaterials(const std::string& filepath, MaterialTable& materials)
+{
+    MappedFile file(filepath.c_str());
+    const char* p = file.begin();
+    const char* end = file.end();
+    std::string name;
+
+    while (p < end)
+    {
+        skipBlanks(p, end);
+        if (startsWith(p, end, "newmtl", 6))
+        {
+            p += 6;
+            name = parseToken(p, end);
+            materials.add(name, packRGB(255, 255, 255));
+        }
+        else if (startsWith(p, end, "Kd", 2))
+        {
+            p += 2;
+            float r = parseFloat(p, end);
+            float g = parseFloat(p, end);
+            float b = parseFloat(p, end);
+            materials.add(name, packRGB((int) (r * 255.0f), (int) (g * 255.0f), (int) (b * 255.0f)));
+        }
+        else if (startsWith(p, end, "map_Kd", 6))
+        {
+            p += 6;
+            int i = materials.find(name);
+            if (i < 0) i = materials.add(name, packRGB(255, 255, 255));
+            materials.setTexture(i, parseToken(p, end));
+        }
+        skipLine(p, end);
+    }
+}
+
+/**
+ * A run of whole lines of an .obj file, parsed independently of the others.
+ *
+ * A counting pass fills in how many v, vt and vn records come before the
+ * chunk, so indices, including negative ones, resolve to global values
+ * while the chunk is parsed. Its geometry is kept in a chunk-local Mesh
+ * until every chunk is done and the results are stitched together.
+ */
+struct ObjChunk
+{
+    const char* begin;
+    const char* end;
+
+    uint32_t positionCount, texCoordCount, normalCount;
+    uint32_t positionBase, texCoordBase, normalBase;
+    std::vector<std::string> materialLibraries;
+
+    Mesh part;
+    uint32_t triangleBase;
+    uint32_t firstMaterial;
+    uint32_t lastMaterial;
+};
+
+/**
+ * Counts the vertex records of a chunk and collects its mtllib records.
+ */
+void countOBJChunk(ObjChunk& chunk)
+{
+    chunk.positionCount = chunk.texCoordCount = chunk.normalCount = 0;
+
+    const char* p = chunk.begin;
+    const char* end = chunk.end;
+    while (p < end)
+    {
+        skipBlanks(p, end);
+        if (startsWith(p, end, "v", 1)) ++chunk.positionCount;
+        else if (startsWith(p, end, "vt", 2)) ++chunk.texCoordCount;
+        else if (startsWith(p, end, "vn", 2)) ++chunk.normalCount;
+        else if (startsWith(p, end, "mtllib", 6))
+        {
+            p += 6;
+            chunk.materialLibraries.push_back(parseToken(p, end));
+        }
+        skipLine(p, end);
+    }
+}
+
+/**
+ * Parses the records of a chunk into its chunk-local Mesh.
+ * Faces that come before the chunk's first usemtl get NO_INDEX as their
+ * material, to be replaced by the material in effect at the end of the previous chunk.
+ *
+ * @param chunk The chunk, with its bases filled in.
+ * @param materials Every material of the file.
+ * @param scaleFactor A value all the vertices are scaled by.
+ */
+void parseOBJChunk(ObjChunk& chunk, const MaterialTable& materials, float scaleFactor)
+{
+    Mesh& mesh = chunk.part;
+    mesh.positions.x.reserve(chunk.positionCount);
+    mesh.positions.y.reserve(chunk.positionCount);
+    mesh.positions.z.reserve(chunk.positionCount);
+
+    uint32_t material = NO_INDEX;
+
+    const char* p = chunk.begin;
+    const char* end = chunk.end;
+    while (p < end)
+    {
+        skipBlanks(p, end);
+        if (p == end) break;
+
+        if (startsWith(p, end, "v", 1))
+        {
+            p += 1;
+            float x = parseFloat(p, end);
+            float y = parseFloat(p, end);
+            float z = parseFloat(p, end);
+            mesh.positions.push_back(glm::vec3(x, y, z) * scaleFactor);
+        }
+        else if (startsWith(p, end, "vt", 2))
+        {
+            p += 2;
+            float u = parseFloat(p, end);
+            skipBlanks(p, end);
+            float v = p < end && *p != '\n' ? parseFloat(p, end) : 0.0f;
+            mesh.texCoords.push_back(u, v);
+        }
+        else if (startsWith(p, end, "vn", 2))
+        {
+            p += 2;
+            float x = parseFloat(p, end);
+            float y = parseFloat(p, end);
+            float z = parseFloat(p, end);
+            mesh.normals.push_back(glm::vec3(x, y, z));
+        }
+        else if (startsWith(p, end, "f", 1))
+        {
+            p += 1;
+            uint32_t positionsSoFar = chunk.positionBase + mesh.positions.size();
+            uint32_t texCoordsSoFar = chunk.texCoordBase + mesh.texCoords.size();
+            uint32_t normalsSoFar = chunk.normalBase + mesh.normals.size();
+
+            // Corners are read one at a time and fanned out from the first.
+            uint32_t first[3], previous[3];
+            int corners = 0;
+            skipBlanks(p, end);
+            while (p < end && *p != '\n' && *p != '#')
+            {
+                const char* token = p;
+                uint32_t corner[3];
+                corner[0] = resolveIndex(parseInt(p, end), positionsSoFar);
+                if (p == token || corner[0] >= positionsSoFar) break; // Malformed, drop the rest of the face.
+                corner[1] = NO_INDEX;
+                corner[2] = NO_INDEX;
+                if (p < end && *p == '/')
+                {
+                    ++p;
+                    if (p < end && (isDigit(*p) || *p == '-')) corner[1] = resolveIndex(parseInt(p, end), texCoordsSoFar);
+                    if (p < end && *p == '/')
+                    {
+                        ++p;
+                        if (p < end && (isDigit(*p) || *p == '-')) corner[2] = resolveIndex(parseInt(p, end), normalsSoFar);
+                    }
+                }
+
+                // Attributes that are not defined yet are dropped, leaving the corner without them.
+                if (corner[1] >= texCoordsSoFar) corner[1] = NO_INDEX;
+                if (corner[2] >= normalsSoFar) corner[2] = NO_INDEX;
+
+                if (corners == 0) memcpy(first, corner, sizeof(corner));
+                if (corners >= 2)
+                {
+                    const uint32_t* triangle[3] = {first, previous, corner};
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        size_t cornerNumber = mesh.indices.size();
+                        mesh.indices.push_back(triangle[i][0]);
+                        pushCornerIndex(mesh.texCoordIndices, cornerNumber, triangle[i][1]);
+                        pushCornerIndex(mesh.normalIndices, cornerNumber, triangle[i][2]);
+                    }
+                    mesh.materialIds.push_back(material);
+                }
+                memcpy(previous, corner, sizeof(corner));
+                ++corners;
+                skipBlanks(p, end);
+            }
+        }
+        else if (startsWith(p, end, "o", 1))
+        {
+            p += 1;
+            MeshObject object;
+            object.name = parseToken(p, end);
+            object.firstTriangle = mesh.triangleCount();
+            object.firstVertex = mesh.positions.size();
+            mesh.objects.push_back(object);
+        }
+        else if (startsWith(p, end, "usemtl", 6))
+        {
+            p += 6;
+            int found = materials.find(parseToken(p, end));
+            material = found < 0 ? 0 : found;
+        }
+
+        skipLine(p, end);
+    }
+
+    chunk.lastMaterial = material;
+}
+
+/**
+ * Copies a parsed chunk into its place in the final mesh.
+ */
+void mergeOBJChunk(const ObjChunk& chunk, Mesh& mesh)
+{
+    const Mesh& part = chunk.part;
+    std::copy(part.positions.x.begin(), part.positions.x.end(), mesh.positions.x.begin() + chunk.positionBase);
+    std::copy(part.positions.y.begin(), part.positions.y.end(), mesh.positions.y.begin() + chunk.positionBase);
+    std::copy(part.positions.z.begin(), part.positions.z.end(), mesh.positions.z.begin() + chunk.positionBase);
+
+    std::copy(part.texCoords.u.begin(), part.texCoords.u.end(), mesh.texCoords.u.begin() + chunk.texCoordBase);
+    std::copy(part.texCoords.v.begin(), part.texCoords.v.end(), mesh.texCoords.v.begin() + chunk.texCoordBase);
+
+    std::copy(part.normals.x.begin(), part.normals.x.end(), mesh.normals.x.begin() + chunk.normalBase);
+    std::copy(part.normals.y.begin(), part.normals.y.end(), mesh.normals.y.begin() + chunk.normalBase);
+    std::copy(part.normals.z.begin(), part.normals.z.end(), mesh.normals.z.begin() + chunk.normalBase);
+
+    size_t cornerBase = 3 * (size_t) chunk.triangleBase;
+    std::copy(part.indices.begin(), part.indices.end(), mesh.indices.begin() + cornerBase);
+
+    // Optional corner attributes are NO_INDEX wherever a chunk has none.
+    if (!mesh.texCoordIndices.empty())
+    {
+        std::copy(part.texCoordIndices.begin(), part.texCoordIndices.end(), mesh.texCoordIndices.begin() + cornerBase);
+    }
+    if (!mesh.normalIndices.empty())
+    {
+        std::copy(part.normalIndices.begin(), part.normalIndices.end(), mesh.normalIndices.begin() + cornerBase);
+    }
+
+    for (int i = 0; i < part.triangleCount(); ++i)
+    {
+        uint32_t material = part.materialIds[i];
+        mesh.materialIds[chunk.triangleBase + i] = material == NO_INDEX ? chunk.firstMaterial : material;
+    }
+}
+
+/**
+ * Load a .obj file into an indexed mesh.
+ *
+ * The file is memory-mapped and tokenized in place. Supports v, vt and vn
+ * records, faces with any number of corners (triangulated as fans) in the
+ * "v", "v/vt", "v//vn" and "v/vt/vn" forms with 1-based or negative
+ * indices, o, usemtl, mtllib and # comments. Other records are skipped.
+ * Materials are read from the .mtl file named by mtllib, relative to the .obj file.
+ *
+ * Given a thread pool the file is split at line boundaries into chunks
+ * that are counted, parsed and copied into place in parallel, with a
+ * prefix sum over the per-chunk counts in between. The mesh is identical
+ * to the one loaded on a single thread.
+ *
+ * @param filepath The location of the .obj file.
+ * @param scaleFactor A value all the vertices describing the mesh will be scaled by.
+ * @param stats If not NULL, receives the size of the file and how long it took to parse.
+ * @param pool If not NULL, the threads to parse on.
+ * @return The mesh.
+ */
+Mesh loadMesh(const char* filepath, float scaleFactor, ParseStats* stats = NULL, ThreadPool* pool = NULL)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    Mesh mesh;
+    MappedFile file(filepath);
+    if (!file.isOpen())
+    {
+        std::cerr << "Error! opening file " << filepath << std::endl;
+        return mesh;
+    }
+
+    std::string directory = filepath;
+    size_t slash = directory.find_last_of('/');
+    directory = slash == std::string::npos ? "" : directory.substr(0, slash + 1);
+
+    // Split into chunks of whole lines. Small files are not worth splitting.
+    const size_t minChunkSize = 1 << 20;
+    size_t chunkCount = pool == NULL ? 1 : std::min<size_t>(pool->size() * 4, file.getSize() / minChunkSize + 1);
+    std::vector<ObjChunk> chunks(chunkCount);
+    const char* p = file.begin();
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        const char* end = i + 1 == chunkCount ? file.end() : file.begin() + file.getSize() * (i + 1) / chunkCount;
+        if (end < p) end = p;
+        if (end < file.end())
+        {
+            const char* newline = (const char*) memchr(end, '\n', file.end() - end);
+            end = newline == NULL ? file.end() : newline + 1;
+        }
+        chunks[i].begin = p;
+        chunks[i].end = end;
+        p = end;
+    }
+
+    auto forEachChunk = [&](const std::function<void(int)>& job)
+    {
+        if (pool == NULL) for (size_t i = 0; i < chunkCount; ++i) job(i);
+        else pool->parallelFor(chunkCount, job);
+    };
+
+    // Count vertex records so every chunk knows where its vertices start.
+    forEachChunk([&](int i) { countOBJChunk(chunks[i]); });
+
+    uint32_t positions = 0, texCoords = 0, normals = 0;
+    for (ObjChunk& chunk : chunks)
+    {
+        chunk.positionBase = positions;
+        chunk.texCoordBase = texCoords;
+        chunk.normalBase = normals;
+        positions += chunk.positionCount;
+        texCoords += chunk.texCoordCount;
+        normals += chunk.normalCount;
+    }
+
+    // Faces before any usemtl are white.
+    mesh.materials.add("", packRGB(255, 255, 255));
+    mesh.sources.push_back(filepath);
+    for (const ObjChunk& chunk : chunks)
+    {
+        for (const std::string& library : chunk.materialLibraries)
+        {
+            loadMaterials(directory + library, mesh.materials);
+            mesh.sources.push_back(directory + library);
+        }
+    }
+
+    forEachChunk([&](int i) { parseOBJChunk(chunks[i], mesh.materials, scaleFactor); });
+
+    // Prefix sums over the parsed triangles, and the material carried into each chunk.
+    uint32_t triangles = 0;
+    uint32_t material = 0;
+    bool hasTexCoordIndices = false, hasNormalIndices = false;
+    for (ObjChunk& chunk : chunks)
+    {
+        chunk.triangleBase = triangles;
+        triangles += chunk.part.triangleCount();
+        chunk.firstMaterial = material;
+        if (chunk.lastMaterial != NO_INDEX) material = chunk.lastMaterial;
+
+        // Keep optional corner attributes parallel to the position indices.
+        hasTexCoordIndices |= !chunk.part.texCoordIndices.empty();
+        hasNormalIndices |= !chunk.part.normalIndices.empty();
+        if (!chunk.part.texCoordIndices.empty()) chunk.part.texCoordIndices.resize(chunk.part.indices.size(), NO_INDEX);
+        if (!chunk.part.normalIndices.empty()) chunk.part.normalIndices.resize(chunk.part.indices.size(), NO_INDEX);
+
+        for (MeshObject object : chunk.part.objects)
+        {
+            object.firstTriangle += chunk.triangleBase;
+            object.firstVertex += chunk.positionBase;
+            mesh.objects.push_back(object);
+        }
+    }
+
+    mesh.positions.x.resize(positions);
+    mesh.positions.y.resize(positions);
+    mesh.positions.z.resize(positions);
+    mesh.texCoords.u.resize(texCoords);
+    mesh.texCoords.v.resize(texCoords);
+    mesh.normals.x.resize(normals);
+    mesh.normals.y.resize(normals);
+    mesh.normals.z.resize(normals);
+    mesh.indices.resize(3 * (size_t) triangles);
+    mesh.materialIds.resize(triangles);
+    if (hasTexCoordIndices) mesh.texCoordIndices.resize(3 * (size_t) triangles, NO_INDEX);
+    if (hasNormalIndices) mesh.normalIndices.resize(3 * (size_t) triangles, NO_INDEX);
+
+    forEachChunk([&](int i)
+    {
+        mergeOBJChunk(chunks[i], mesh);
+        chunks[i].part = Mesh();
+    });
+
+    // Close off the triangle and vertex ranges of each object, and bound the vertices its triangles use.
+    for (size_t i = 0; i < mesh.objects.size(); ++i)
+    {
+        bool last = i + 1 == mesh.objects.size();
+        MeshObject& object = mesh.objects[i];
+        object.triangleCount = (last ? mesh.triangleCount() : mesh.objects[i + 1].firstTriangle) - object.firstTriangle;
+        object.vertexCount = (last ? mesh.positions.size() : mesh.objects[i + 1].firstVertex) - object.firstVertex;
+
+        object.bounds = AABB();
+        for (size_t corner = 3 * (size_t) object.firstTriangle; corner < 3 * (size_t) (object.firstTriangle + object.triangleCount); ++corner)
+        {
+            uint32_t v = mesh.indices[corner];
+            object.bounds.grow(glm::vec3(mesh.positions.x[v], mesh.positions.y[v], mesh.positions.z[v]));
+        }
+        mesh.objectStarts.push_back(object.firstTriangle);
+    }
+
+    if (stats != NULL)
+    {
+        stats->bytes = file.getSize();
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    return mesh;
+}
@@ -0,0 +1,380 @@
+#pragma once
+
+// The frame profiler is only compiled in when PROFILING is defined, as by
+// `make profile`. Otherwise the PROFILE_ macros compile to nothing.
+
+#if defined(PROFILING)
+
+#include <inttypes.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+#include "FrameBuffer.h"
+
+// Frames of statistics kept for the overlay and CSV dumps.
+#define PROFILE_HISTORY 256
+
+// Threads that can record into slots of their own: a 64 core machine's
+// pool, the main thread and the presenter, with room to spare. Any later
+// threads share the last slot, which is locked.
+#define PROFILE_MAX_THREADS 128
+#define PROFILE_SHARED_SLOT (PROFILE_MAX_THREADS - 1)
+
+// Trace events kept between dumps, so leaving tracing on cannot eat all memory.
+#define PROFILE_MAX_EVENTS (1 << 20)
+
+/**
+ * Stages of the pipeline that are timed.
+ */
+enum ProfileStage
+{
+  STAGE_TRANSFORM,
+  STAGE_CLIP_CULL,
+  STAGE_RASTER,
+  STAGE_TEXTURE,
+  STAGE_RAY_TRACE,
+  STAGE_UPSCALE,
+  STAGE_PRESENT,
+  STAGE_COUNT
+};
+
+/**
+ * Things that are counted per frame.
+ */
+enum ProfileCounter
+{
+  // Triangles handed to submitTriangle, those dropped by facing or clipping before binning, and those
+  // set up for rasterizing. A triangle is set up once per tile it touches unless the tile's depth hides it.
+  COUNT_TRIANGLES_SUBMITTED,
+  COUNT_TRIANGLES_CULLED,
+  COUNT_TRIANGLES_OCCLUDED,
+  COUNT_TRIANGLES_RASTERIZED,
+
+  // Pixels inside triangles that were depth tested, those whose colour was
+  // written, and those of the finished frame that anything was drawn to.
+  COUNT_PIXELS_TESTED,
+  COUNT_PIXELS_WRITTEN,
+  COUNT_PIXELS_COVERED,
+  COUNT_COUNT
+};
+
+const char* const STAGE_NAMES[STAGE_COUNT] = {"transform", "clip_cull", "raster", "texture", "ray_trace", "upscale", "present"};
+const char* const COUNTER_NAMES[COUNT_COUNT] = {"triangles_submitted", "triangles_culled", "triangles_occluded",
+                                                "triangles_rasterized", "pixels_tested", "pixels_written", "pixels_covered"};
+
+// Texture sampling runs inside rasterizing, thousands of times a frame, so
+// it is timed but not traced. Its time is summed across threads.
+const bool STAGE_TRACED[STAGE_COUNT] = {true, true, true, false, true, true, true};
+
+// Overlay colours, as packed ARGB.
+const uint32_t STAGE_COLOURS[STAGE_COUNT] = {0xFF4080FF, 0xFF40C0C0, 0xFFFF8040, 0xFFFFC040, 0xFFC060FF, 0xFF80FF80, 0xFFC0C0C0};
+
+/**
+ * What was measured over one frame.
+ */
+struct FrameProfile
+{
+  double frameMilliseconds;
+  double stageMilliseconds[STAGE_COUNT];
+  uint64_t counters[COUNT_COUNT];
+
+  // Colour writes per pixel that ends up drawn.
+  double overdraw() const
+  {
+    uint64_t covered = counters[COUNT_PIXELS_COVERED];
+    return covered > 0 ? (double) counters[COUNT_PIXELS_WRITTEN] / covered : 0.0;
+  }
+};
+
+/**
+ * A complete event in Chrome's trace format, in microseconds since the profiler started.
+ */
+struct TraceEvent
+{
+  int stage;
+  int thread;
+  double start, duration;
+};
+
+/**
+ * Per-frame timers and counters for the whole pipeline.
+ *
+ * Each thread records into a slot of its own, so nothing is shared or
+ * locked while a frame is drawn, unless there are more threads than
+ * slots. The slots are summed when the frame ends,
+ * once the thread pool is idle, into a ring of the last PROFILE_HISTORY
+ * frames.
+ */
+class Profiler
+{
+private:
+  struct alignas(64) ThreadSlot
+  {
+    double stageMilliseconds[STAGE_COUNT];
+    uint64_t counters[COUNT_COUNT];
+    std::vector<TraceEvent> events;
+  };
+
+  ThreadSlot slots[PROFILE_MAX_THREADS];
+  std::atomic<int> slotCount;
+  std::mutex sharedSlot;
+  FrameProfile history[PROFILE_HISTORY];
+  int frames;
+  bool tracing;
+  std::chrono::steady_clock::time_point epoch, frameStart;
+
+public:
+  Profiler()
+  : slotCount(0)
+  , frames(0)
+  , tracing(false)
+  , epoch(std::chrono::steady_clock::now())
+  , frameStart(epoch)
+  {
+    for (ThreadSlot& slot : slots)
+    {
+      std::fill(slot.stageMilliseconds, slot.stageMilliseconds + STAGE_COUNT, 0.0);
+      std::fill(slot.counters, slot.counters + COUNT_COUNT, 0);
+    }
+  }
+
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+  /**
+   * @return The slot of the calling thread, handed out the first time it records.
+   */
+  int threadSlot()
+  {
+    static thread_local int slot = -1;
+    if (slot < 0) slot = std::min(slotCount++, (int) PROFILE_SHARED_SLOT);
+    return slot;
+  }
+
+  double microseconds(std::chrono::steady_clock::time_point t) const
+  {
+    return std::chrono::duration<double, std::micro>(t - epoch).count();
+  }
+
+  void count(ProfileCounter counter, uint64_t n)
+  {
+    int thread = threadSlot();
+    std::unique_lock<std::mutex> lock(sharedSlot, std::defer_lock);
+    if (thread == PROFILE_SHARED_SLOT) lock.lock();
+    slots[thread].counters[counter] += n;
+  }
+
+  void record(ProfileStage stage, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+  {
+    int thread = threadSlot();
+    std::unique_lock<std::mutex> lock(sharedSlot, std::defer_lock);
+    if (thread == PROFILE_SHARED_SLOT) lock.lock();
+    ThreadSlot& slot = slots[thread];
+    slot.stageMilliseconds[stage] += std::chrono::duration<double, std::milli>(end - start).count();
+    if (tracing && STAGE_TRACED[stage] && slot.events.size() < PROFILE_MAX_EVENTS / PROFILE_MAX_THREADS)
+    {
+      TraceEvent event = {stage, thread, microseconds(start), microseconds(end) - microseconds(start)};
+      slot.events.push_back(event);
+    }
+  }
+
+  /**
+   * Starts or stops keeping trace events for writeTrace.
+   */
+  void setTracing(bool on)
+  {
+    tracing = on;
+  }
+
+  bool isTracing() const
+  {
+    return tracing;
+  }
+
+  void beginFrame()
+  {
+    frameStart = std::chrono::steady_clock::now();
+  }
+
+  /**
+   * Sums every thread's records into the history. Must be called while no other thread is recording.
+   */
+  void endFrame()
+  {
+    FrameProfile& frame = history[frames % PROFILE_HISTORY];
+    frame.frameMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+    std::fill(frame.stageMilliseconds, frame.stageMilliseconds + STAGE_COUNT, 0.0);
+    std::fill(frame.counters, frame.counters + COUNT_COUNT, 0);
+
+    int used = std::min((int) slotCount, PROFILE_MAX_THREADS);
+    for (int i = 0; i < used; ++i)
+    {
+      ThreadSlot& slot = slots[i];
+      for (int s = 0; s < STAGE_COUNT; ++s) frame.stageMilliseconds[s] += slot.stageMilliseconds[s];
+      for (int c = 0; c < COUNT_COUNT; ++c) frame.counters[c] += slot.counters[c];
+      std::fill(slot.stageMilliseconds, slot.stageMilliseconds + STAGE_COUNT, 0.0);
+      std::fill(slot.counters, slot.counters + COUNT_COUNT, 0);
+    }
+    ++frames;
+  }
+
+  /**
+   * @return The number of frames in the history, up to PROFILE_HISTORY.
+   */
+  int historySize() const
+  {
+    return std::min(frames, PROFILE_HISTORY);
+  }
+
+  /**
+   * @param age How many frames ago, 0 for the last one ended.
+   */
+  const FrameProfile& frame(int age) const
+  {
+    return history[(frames - 1 - age) % PROFILE_HISTORY];
+  }
+
+  /**
+   * Writes the history as CSV, oldest frame first, one column per stage and counter.
+   *
+   * @param fileName The file to write.
+   * @return False if the file could not be written.
+   */
+  bool writeCSV(const char* fileName) const
+  {
+    FILE* file = fopen(fileName, "w");
+    if (file == NULL) return false;
+
+    fprintf(file, "frame,frame_ms");
+    for (int s = 0; s < STAGE_COUNT; ++s) fprintf(file, ",%s_ms", STAGE_NAMES[s]);
+    for (int c = 0; c < COUNT_COUNT; ++c) fprintf(file, ",%s", COUNTER_NAMES[c]);
+    fprintf(file, ",overdraw\n");
+
+    for (int age = historySize() - 1; age >= 0; --age)
+    {
+      const FrameProfile& f = frame(age);
+      fprintf(file, "%d,%.4f", frames - 1 - age, f.frameMilliseconds);
+      for (int s = 0; s < STAGE_COUNT; ++s) fprintf(file, ",%.4f", f.stageMilliseconds[s]);
+      for (int c = 0; c < COUNT_COUNT; ++c) fprintf(file, ",%" PRIu64, f.counters[c]);
+      fprintf(file, ",%.4f\n", f.overdraw());
+    }
+    return fclose(file) == 0;
+  }
+
+  /**
+   * Writes the trace events kept since the last call in Chrome's trace
+   * event format, for chrome://tracing or Perfetto, and forgets them.
+   *
+   * @param fileName The file to write.
+   * @return False if the file could not be written.
+   */
+  bool writeTrace(const char* fileName)
+  {
+    FILE* file = fopen(fileName, "w");
+    if (file == NULL) return false;
+
+    fprintf(file, "{\"traceEvents\":[");
+    bool first = true;
+    for (ThreadSlot& slot : slots)
+    {
+      for (const TraceEvent& e : slot.events)
+      {
+        fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                first ? "" : ",", STAGE_NAMES[e.stage], e.thread, e.start, e.duration);
+        first = false;
+      }
+      slot.events.clear();
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+  }
+
+  /**
+   * Draws the history as a bar per frame in the bottom left corner: each
+   * stage stacked in its own colour, over a grey bar of the whole frame
+   * time, with a white line at 1/60 s. Texture time is left out, as it is
+   * part of rasterizing.
+   *
+   * @param target The frame to draw over.
+   */
+  void drawOverlay(FrameBuffer& target) const
+  {
+    const int barWidth = 2, graphHeight = 120;
+    const float pixelsPerMillisecond = graphHeight / 33.3f;
+    int bars = std::min(historySize(), target.width / barWidth);
+    if (bars == 0) return;
+    target.clearRect(0, target.height - graphHeight - 1, bars * barWidth - 1, target.height - 1, 0xFF000000);
+
+    for (int i = 0; i < bars; ++i)
+    {
+      const FrameProfile& f = frame(bars - 1 - i);
+      int x0 = i * barWidth;
+      int top = target.height - 1 - std::min(graphHeight, (int) (f.frameMilliseconds * pixelsPerMillisecond));
+      int y = target.height - 1;
+      for (int s = 0; s <= STAGE_COUNT; ++s)
+      {
+        // The last pass fills the rest of the frame time in grey.
+        if (s < STAGE_COUNT && s == STAGE_TEXTURE) continue;
+        int height = s < STAGE_COUNT ? (int) (f.stageMilliseconds[s] * pixelsPerMillisecond) : y - top;
+        uint32_t colour = s < STAGE_COUNT ? STAGE_COLOURS[s] : 0xFF606060;
+        for (int end = std::max(y - height, target.height - 1 - graphHeight); y > end; --y)
+        {
+          for (int x = x0; x < x0 + barWidth; ++x) target.setPixel(x, y, colour);
+        }
+      }
+    }
+
+    int budget = target.height - 1 - (int) (16.7f * pixelsPerMillisecond);
+    for (int x = 0; x < bars * barWidth; ++x) target.setPixel(x, budget, 0xFFFFFFFF);
+  }
+};
+
+/**
+ * The profiler every PROFILE_ macro records into.
+ */
+inline Profiler& profiler()
+{
+  static Profiler instance;
+  return instance;
+}
+
+/**
+ * Times the rest of the enclosing block as a stage.
+ */
+class ProfileScope
+{
+private:
+  ProfileStage stage;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  ProfileScope(ProfileStage stage)
+  : stage(stage)
+  , start(std::chrono::steady_clock::now())
+  {}
+
+  ~ProfileScope()
+  {
+    profiler().record(stage, start, std::chrono::steady_clock::now());
+  }
+};
+
+#define PROFILE_JOIN(a, b) a##b
+#define PROFILE_NAME(line) PROFILE_JOIN(profileScope, line)
+#define PROFILE_SCOPE(stage) ProfileScope PROFILE_NAME(__LINE__)(stage)
+#define PROFILE_COUNT(counter, n) profiler().count(counter, n)
+#define PROFILE_BEGIN_FRAME() profiler().beginFrame()
+#define PROFILE_END_FRAME() profiler().endFrame()
+
+#else
+
+// Counts are still named, but never evaluated, so whatever feeds them is not reported as unused.
+#define PROFILE_SCOPE(stage)
+#define PROFILE_COUNT(counter, n) ((void) sizeof(n))
+#define PROFILE_BEGIN_FRAME()
+#define PROFILE_END_FRAME()
+
+#endif
@@ -0,0 +1,501 @@
+#pragma once
+
+#include <inttypes.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <CanvasTriangle.h>
+#include "FrameBuffer.h"
+#include "Profiler.h"
+#include "SpanKernel.h"
+#include "Texture.h"
+
+// Vertex positions are snapped to a grid of 1/16th of a pixel.
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_ONE (1 << SUBPIXEL_BITS)
+
+// Projected coordinates are clamped to this many subpixels either side of
+// the origin so the edge functions can never overflow 64 bits. Clipped
+// triangles stay well inside it (see CLIP_GUARD_BAND in Clipper.h).
+#define GUARD_BAND (1LL << 28)
+
+/**
+ * Snaps a screen space coordinate to the subpixel grid.
+ *
+ * @param value A coordinate in pixels.
+ * @return The coordinate in fixed point subpixels.
+ */
+inline int64_t toFixed(float value)
+{
+  double fixed = std::floor((double) value * SUBPIXEL_ONE + 0.5);
+  if (fixed > GUARD_BAND) return GUARD_BAND;
+  if (fixed < -GUARD_BAND) return -GUARD_BAND;
+  return (int64_t) fixed;
+}
+
+/**
+ * Whether pixels lying exactly on an edge belong to the triangle.
+ * With the winding used by rasterizeTriangle the inside of every edge
+ * lies on its positive side, so a left edge runs upwards (dy < 0) and a
+ * top edge runs horizontally to the right.
+ *
+ * @param dx The x component of the edge vector.
+ * @param dy The y component of the edge vector.
+ * @return True if the edge is a top or left edge.
+ */
+inline bool isTopLeft(int64_t dx, int64_t dy)
+{
+  return dy < 0 || (dy == 0 && dx > 0);
+}
+
+/**
+ * A screen space attribute a + dx * x + dy * y, evaluated at pixel centres.
+ */
+struct Plane
+{
+  float origin, dx, dy;
+
+  /**
+   * Bounds the plane over a rectangle of pixels. Being linear, it is
+   * highest and lowest at opposite corners.
+   */
+  void range(int x0, int y0, int x1, int y1, float& lowest, float& highest) const
+  {
+    float corner = origin + dx * x0 + dy * y0;
+    float spanX = dx * (x1 - x0), spanY = dy * (y1 - y0);
+    lowest = corner + std::min(spanX, 0.0f) + std::min(spanY, 0.0f);
+    highest = corner + std::max(spanX, 0.0f) + std::max(spanY, 0.0f);
+  }
+};
+
+/**
+ * The per-triangle state shared by every fill routine: snapped vertices,
+ * clipped bounding box and the edge functions at its first pixel.
+ */
+struct TriangleSetup
+{
+  int64_t x0, y0, x1, y1, x2, y2;
+  int order[3];
+  int minX, minY, maxX, maxY;
+  int64_t rowW0, rowW1, rowW2;
+  int64_t stepX0, stepX1, stepX2;
+  int64_t stepY0, stepY1, stepY2;
+  float fx1, fy1, fx2, fy2, invDet;
+
+  /**
+   * Snaps the vertices to the subpixel grid and sets up the edge functions.
+   *
+   * @return False if the triangle has no area or misses the clip rectangle.
+   */
+  bool setup(const CanvasPoint& v0, const CanvasPoint& v1, const CanvasPoint& v2,
+             int clipMinX, int clipMinY, int clipMaxX, int clipMaxY)
+  {
+    x0 = toFixed(v0.x); y0 = toFixed(v0.y);
+    x1 = toFixed(v1.x); y1 = toFixed(v1.y);
+    x2 = toFixed(v2.x); y2 = toFixed(v2.y);
+    order[0] = 0; order[1] = 1; order[2] = 2;
+
+    // Both windings are filled; flip clockwise triangles so the area is positive.
+    int64_t area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+    if (area == 0) return false;
+    if (area < 0)
+    {
+      std::swap(x1, x2);
+      std::swap(y1, y2);
+      std::swap(order[1], order[2]);
+    }
+
+    // Bounding box in whole pixels, clipped to the clip rectangle.
+    minX = (int) std::max<int64_t>(std::min(x0, std::min(x1, x2)) >> SUBPIXEL_BITS, clipMinX);
+    minY = (int) std::max<int64_t>(std::min(y0, std::min(y1, y2)) >> SUBPIXEL_BITS, clipMinY);
+    maxX = (int) std::min<int64_t>(std::max(x0, std::max(x1, x2)) >> SUBPIXEL_BITS, clipMaxX);
+    maxY = (int) std::min<int64_t>(std::max(y0, std::max(y1, y2)) >> SUBPIXEL_BITS, clipMaxY);
+    if (minX > maxX || minY > maxY) return false;
+
+    // Edge function steps for one pixel in x and y.
+    // Edge i is the edge opposite vertex i.
+    stepX0 = (y1 - y2) * SUBPIXEL_ONE; stepY0 = (x2 - x1) * SUBPIXEL_ONE;
+    stepX1 = (y2 - y0) * SUBPIXEL_ONE; stepY1 = (x0 - x2) * SUBPIXEL_ONE;
+    stepX2 = (y0 - y1) * SUBPIXEL_ONE; stepY2 = (x1 - x0) * SUBPIXEL_ONE;
+
+    // Edge functions at the centre of the first pixel, biased by the
+    // top-left rule so a simple sign test decides coverage.
+    int64_t px = ((int64_t) minX << SUBPIXEL_BITS) + SUBPIXEL_ONE / 2;
+    int64_t py = ((int64_t) minY << SUBPIXEL_BITS) + SUBPIXEL_ONE / 2;
+    rowW0 = (x2 - x1) * (py - y1) - (y2 - y1) * (px - x1) - (isTopLeft(x2 - x1, y2 - y1) ? 0 : 1);
+    rowW1 = (x0 - x2) * (py - y2) - (y0 - y2) * (px - x2) - (isTopLeft(x0 - x2, y0 - y2) ? 0 : 1);
+    rowW2 = (x1 - x0) * (py - y0) - (y1 - y0) * (px - x0) - (isTopLeft(x1 - x0, y1 - y0) ? 0 : 1);
+
+    fx1 = (float) (x1 - x0) / SUBPIXEL_ONE; fy1 = (float) (y1 - y0) / SUBPIXEL_ONE;
+    fx2 = (float) (x2 - x0) / SUBPIXEL_ONE; fy2 = (float) (y2 - y0) / SUBPIXEL_ONE;
+    invDet = 1.0f / (fx1 * fy2 - fx2 * fy1);
+    return true;
+  }
+
+  /**
+   * Fits a plane through an attribute's values at the three vertices,
+   * relative to the centre of pixel (0, 0). The values are given in the
+   * order the vertices were passed to setup.
+   */
+  Plane plane(float a0, float a1, float a2) const
+  {
+    float a[3] = {a0, a1, a2};
+    float b0 = a[order[0]], b1 = a[order[1]], b2 = a[order[2]];
+
+    Plane p;
+    p.dx = ((b1 - b0) * fy2 - (b2 - b0) * fy1) * invDet;
+    p.dy = (fx1 * (b2 - b0) - fx2 * (b1 - b0)) * invDet;
+    p.origin = b0 + p.dx * (0.5f - (float) x0 / SUBPIXEL_ONE) + p.dy * (0.5f - (float) y0 / SUBPIXEL_ONE);
+    return p;
+  }
+
+  /**
+   * Finds the covered pixels of a row. The triangle is convex, so they are
+   * a single run; each edge bounds it on one side, found by solving
+   * w + step * k >= 0 exactly in integers.
+   *
+   * @param w0 Edge function 0 at column minX of the row.
+   * @param w1 Edge function 1 at column minX of the row.
+   * @param w2 Edge function 2 at column minX of the row.
+   * @param first Receives the first covered column.
+   * @param last Receives the last covered column.
+   * @return False if no pixel of the row is covered.
+   */
+  bool rowSpan(int64_t w0, int64_t w1, int64_t w2, int& first, int& last) const
+  {
+    int64_t lo = 0, hi = maxX - minX;
+    if (!clampSpan(w0, stepX0, lo, hi) || !clampSpan(w1, stepX1, lo, hi) || !clampSpan(w2, stepX2, lo, hi)) return false;
+    first = minX + (int) lo;
+    last = minX + (int) hi;
+    return true;
+  }
+
+  static bool clampSpan(int64_t w, int64_t step, int64_t& lo, int64_t& hi)
+  {
+    if (step == 0) return w >= 0;
+    if (step > 0)
+    {
+      if (w < 0) lo = std::max(lo, (-w + step - 1) / step);
+    }
+    else
+    {
+      if (w < 0) return false;
+      hi = std::min(hi, w / -step);
+    }
+    return lo <= hi;
+  }
+
+  /**
+   * Tests the pixel centres of a rectangle against the edges. Each edge
+   * function is linear, so checking the corners is enough.
+   *
+   * @return -1 if no pixel is covered, 1 if every pixel is, otherwise 0.
+   */
+  int coverage(int rectX0, int rectY0, int rectX1, int rectY1) const
+  {
+    int64_t dx = rectX0 - minX, dy = rectY0 - minY;
+    int64_t w[3] = {rowW0 + stepX0 * dx + stepY0 * dy, rowW1 + stepX1 * dx + stepY1 * dy, rowW2 + stepX2 * dx + stepY2 * dy};
+    int64_t acrossX[3] = {stepX0 * (rectX1 - rectX0), stepX1 * (rectX1 - rectX0), stepX2 * (rectX1 - rectX0)};
+    int64_t acrossY[3] = {stepY0 * (rectY1 - rectY0), stepY1 * (rectY1 - rectY0), stepY2 * (rectY1 - rectY0)};
+
+    bool inside = true;
+    for (int i = 0; i < 3; ++i)
+    {
+      int64_t lowest = w[i] + std::min<int64_t>(acrossX[i], 0) + std::min<int64_t>(acrossY[i], 0);
+      int64_t highest = w[i] + std::max<int64_t>(acrossX[i], 0) + std::max<int64_t>(acrossY[i], 0);
+      if (highest < 0) return -1;
+      inside = inside && lowest >= 0;
+    }
+    return inside ? 1 : 0;
+  }
+};
+
+/**
+ * How far a depth evaluated at a pixel may stray from the exact plane
+ * through float rounding, so block tests stay conservative.
+ */
+inline float depthMargin(const TriangleSetup& t, const Plane& z)
+{
+  return 4 * FLT_EPSILON * (std::abs(z.origin) + std::abs(z.dx) * (t.maxX + 1) + std::abs(z.dy) * (t.maxY + 1));
+}
+
+/**
+ * Tests a triangle against the depth blocks under its bounding box.
+ * Stale blocks the test depends on are refreshed on the way.
+ *
+ * @param t The triangle.
+ * @param z Its depth plane.
+ * @param frame The frame buffer it is to be drawn into.
+ * @return True if in every block it covers, the triangle is behind everything already drawn.
+ */
+bool isOccluded(const TriangleSetup& t, const Plane& z, FrameBuffer& frame)
+{
+  float margin = depthMargin(t, z);
+  for (int by = t.minY >> DEPTH_BLOCK_BITS; by <= t.maxY >> DEPTH_BLOCK_BITS; ++by)
+  {
+    int y0 = std::max(by << DEPTH_BLOCK_BITS, t.minY);
+    int y1 = std::min(((by + 1) << DEPTH_BLOCK_BITS) - 1, t.maxY);
+    for (int bx = t.minX >> DEPTH_BLOCK_BITS; bx <= t.maxX >> DEPTH_BLOCK_BITS; ++bx)
+    {
+      int x0 = std::max(bx << DEPTH_BLOCK_BITS, t.minX);
+      int x1 = std::min(((bx + 1) << DEPTH_BLOCK_BITS) - 1, t.maxX);
+      int block = bx + frame.blocksX * by;
+
+      float lowest, highest;
+      z.range(x0, y0, x1, y1, lowest, highest);
+      if (highest + margin <= frame.blockMin[block]) continue;
+      if (t.coverage(x0, y0, x1, y1) < 0) continue;
+
+      if (!frame.blockStale[block]) return false;
+      frame.refreshBlock(bx, by);
+      if (highest + margin > frame.blockMin[block]) return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Updates the depth blocks under a freshly drawn triangle. Blocks it
+ * covers completely are raised to its farthest depth in them, as every
+ * pixel there is now at least that near; the rest are marked stale.
+ *
+ * @param t The triangle.
+ * @param z Its depth plane.
+ * @param frame The frame buffer it was drawn into.
+ */
+void updateBlocks(const TriangleSetup& t, const Plane& z, FrameBuffer& frame)
+{
+  float margin = depthMargin(t, z);
+  for (int by = t.minY >> DEPTH_BLOCK_BITS; by <= t.maxY >> DEPTH_BLOCK_BITS; ++by)
+  {
+    int y0 = by << DEPTH_BLOCK_BITS;
+    int y1 = std::min(y0 + DEPTH_BLOCK_SIZE, frame.height) - 1;
+    for (int bx = t.minX >> DEPTH_BLOCK_BITS; bx <= t.maxX >> DEPTH_BLOCK_BITS; ++bx)
+    {
+      int x0 = bx << DEPTH_BLOCK_BITS;
+      int x1 = std::min(x0 + DEPTH_BLOCK_SIZE, frame.width) - 1;
+      int block = bx + frame.blocksX * by;
+
+      // Only a block wholly inside the bounding box can be wholly covered.
+      if (x0 < t.minX || y0 < t.minY || x1 > t.maxX || y1 > t.maxY || t.coverage(x0, y0, x1, y1) < 1)
+      {
+        frame.blockStale[block] = 1;
+        continue;
+      }
+
+      float lowest, highest;
+      z.range(x0, y0, x1, y1, lowest, highest);
+      frame.blockMin[block] = std::max(frame.blockMin[block], lowest - margin);
+    }
+  }
+}
+
+/**
+ * Fills a depth tested triangle into a frame buffer using half-space edge functions.
+ *
+ * Edge functions are evaluated in fixed point at pixel centres, so
+ * neighbouring triangles sharing an edge never both cover (or both miss) a
+ * pixel. Each row's covered run is solved for exactly and handed to the
+ * span kernel, which depth tests and fills it several pixels at a time.
+ * Depth is 1/z, which is linear in screen space, and is evaluated from its
+ * plane equation so a pixel always receives the same depth no matter where
+ * the fill starts. Triangles hidden in every depth block they touch are
+ * rejected before any pixel is visited. Nothing is allocated.
+ *
+ * @param v0 The first vertex, in pixels.
+ * @param v1 The second vertex, in pixels.
+ * @param v2 The third vertex, in pixels.
+ * @param colour A bitpacked ARGB colour.
+ * @param frame The frame buffer the triangle is to be drawn into.
+ * @param clipMinX The leftmost column that may be written.
+ * @param clipMinY The topmost row that may be written.
+ * @param clipMaxX The rightmost column that may be written.
+ * @param clipMaxY The bottom row that may be written.
+ * @param mode What the fill does with the depth buffer.
+ */
+void rasterizeTriangle(const CanvasPoint& v0, const CanvasPoint& v1, const CanvasPoint& v2, uint32_t colour, FrameBuffer& frame,
+                       int clipMinX, int clipMinY, int clipMaxX, int clipMaxY, DepthMode mode = DEPTH_NEARER)
+{
+  // Triangles touching or behind the camera plane are not drawn.
+  if (v0.depth <= 0 || v1.depth <= 0 || v2.depth <= 0) return;
+
+  TriangleSetup t;
+  if (!t.setup(v0, v1, v2, clipMinX, clipMinY, clipMaxX, clipMaxY)) return;
+  Plane z = t.plane(v0.depth, v1.depth, v2.depth);
+  if (isOccluded(t, z, frame))
+  {
+    PROFILE_COUNT(COUNT_TRIANGLES_OCCLUDED, 1);
+    return;
+  }
+
+  FillSpan fill = spanKernels().fill;
+  int tested = 0, passed = 0;
+  int64_t rowW0 = t.rowW0, rowW1 = t.rowW1, rowW2 = t.rowW2;
+  for (int y = t.minY; y <= t.maxY; ++y)
+  {
+    int first, last;
+    if (t.rowSpan(rowW0, rowW1, rowW2, first, last))
+    {
+      int row = frame.width * y;
+      passed += fill(frame.depth + row, frame.pixels + row, first, last - first + 1, z.origin + z.dy * y, z.dx, colour, mode);
+      tested += last - first + 1;
+    }
+
+    rowW0 += t.stepY0;
+    rowW1 += t.stepY1;
+    rowW2 += t.stepY2;
+  }
+
+  PROFILE_COUNT(COUNT_TRIANGLES_RASTERIZED, 1);
+  PROFILE_COUNT(COUNT_PIXELS_TESTED, tested);
+  PROFILE_COUNT(COUNT_PIXELS_WRITTEN, mode == DEPTH_ONLY ? 0 : passed);
+  if (mode != DEPTH_EQUAL) updateBlocks(t, z, frame);
+  frame.markDirty(t.minX, t.minY, t.maxX, t.maxY);
+}
+
+/**
+ * Fills a depth tested triangle anywhere in a frame buffer.
+ *
+ * @param v0 The first vertex, in pixels.
+ * @param v1 The second vertex, in pixels.
+ * @param v2 The third vertex, in pixels.
+ * @param colour A bitpacked ARGB colour.
+ * @param frame The frame buffer the triangle is to be drawn into.
+ */
+void rasterizeTriangle(const CanvasPoint& v0, const CanvasPoint& v1, const CanvasPoint& v2, uint32_t colour, FrameBuffer& frame)
+{
+  rasterizeTriangle(v0, v1, v2, colour, frame, 0, 0, frame.width - 1, frame.height - 1);
+}
+
+// The most pixels of a row handed to the texture sampler at once.
+#define TEXTURE_SPAN 64
+
+/**
+ * Level of detail at a pixel, from the screen space derivatives of the
+ * texture coordinates. The coordinates are the planes u/z and v/z divided
+ * by the plane 1/z, so their derivatives follow from the quotient rule.
+ */
+inline float levelOfDetail(const Plane& z, const Plane& u, const Plane& v, float depth, float uValue, float vValue,
+                           float textureWidth, float textureHeight)
+{
+  float w = 1.0f / depth;
+  float dudx = (u.dx - uValue * z.dx) * w * textureWidth;
+  float dvdx = (v.dx - vValue * z.dx) * w * textureHeight;
+  float dudy = (u.dy - uValue * z.dy) * w * textureWidth;
+  float dvdy = (v.dy - vValue * z.dy) * w * textureHeight;
+  float rho = std::max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+  return rho > 0 ? 0.5f * log2f(rho) : 0.0f;
+}
+
+/**
+ * Fills a depth tested, perspective correct textured triangle into a frame buffer.
+ *
+ * Uses the same coverage and occlusion rules as rasterizeTriangle, with the
+ * span kernel listing the pixels that pass the depth test. u/z, v/z and 1/z
+ * are linear in screen space, so they are interpolated as planes and
+ * divided per pixel, and only for those pixels. They are
+ * gathered into spans of up to TEXTURE_SPAN and sampled together, with one
+ * level of detail per span.
+ *
+ * @param v0 The first vertex, in pixels. Its texturePoint holds its texture coordinates, from 0 to 1.
+ * @param v1 The second vertex, in pixels.
+ * @param v2 The third vertex, in pixels.
+ * @param texture The texture the triangle is drawn with.
+ * @param filter How texels are combined.
+ * @param address How texture coordinates outside 0 to 1 are treated.
+ * @param frame The frame buffer the triangle is to be drawn into.
+ * @param clipMinX The leftmost column that may be written.
+ * @param clipMinY The topmost row that may be written.
+ * @param clipMaxX The rightmost column that may be written.
+ * @param clipMaxY The bottom row that may be written.
+ * @param mode What the fill does with the depth buffer.
+ */
+void rasterizeTexturedTriangle(const CanvasPoint& v0, const CanvasPoint& v1, const CanvasPoint& v2,
+                               const Texture& texture, TextureFilter filter, TextureAddress address, FrameBuffer& frame,
+                               int clipMinX, int clipMinY, int clipMaxX, int clipMaxY, DepthMode mode = DEPTH_NEARER)
+{
+  if (v0.depth <= 0 || v1.depth <= 0 || v2.depth <= 0 || texture.isEmpty()) return;
+
+  TriangleSetup t;
+  if (!t.setup(v0, v1, v2, clipMinX, clipMinY, clipMaxX, clipMaxY)) return;
+  Plane z = t.plane(v0.depth, v1.depth, v2.depth);
+  if (isOccluded(t, z, frame))
+  {
+    PROFILE_COUNT(COUNT_TRIANGLES_OCCLUDED, 1);
+    return;
+  }
+  Plane u = t.plane(v0.texturePoint.x * v0.depth, v1.texturePoint.x * v1.depth, v2.texturePoint.x * v2.depth);
+  Plane v = t.plane(v0.texturePoint.y * v0.depth, v1.texturePoint.y * v1.depth, v2.texturePoint.y * v2.depth);
+  float textureWidth = texture.getWidth();
+  float textureHeight = texture.getHeight();
+
+  int spanX[TEXTURE_SPAN];
+  float spanU[TEXTURE_SPAN], spanV[TEXTURE_SPAN];
+  uint32_t spanColour[TEXTURE_SPAN];
+
+  const SpanKernels& kernels = spanKernels();
+  int tested = 0, written = 0;
+  int64_t rowW0 = t.rowW0, rowW1 = t.rowW1, rowW2 = t.rowW2;
+  for (int y = t.minY; y <= t.maxY; ++y)
+  {
+    int first, last;
+    if (!t.rowSpan(rowW0, rowW1, rowW2, first, last))
+    {
+      rowW0 += t.stepY0;
+      rowW1 += t.stepY1;
+      rowW2 += t.stepY2;
+      continue;
+    }
+
+    float zRow = z.origin + z.dy * y;
+    float uRow = u.origin + u.dy * y;
+    float vRow = v.origin + v.dy * y;
+    int row = frame.width * y;
+    tested += last - first + 1;
+
+    if (mode == DEPTH_ONLY)
+    {
+      kernels.fill(frame.depth + row, frame.pixels + row, first, last - first + 1, zRow, z.dx, 0, mode);
+    }
+    else
+    {
+      // Visible pixels are gathered until a span is full, then sampled together.
+      int count = 0;
+      float lod = 0;
+      for (int x = first; x <= last;)
+      {
+        int run = std::min(last - x + 1, TEXTURE_SPAN - count);
+        int passed = kernels.test(frame.depth + row, x, run, zRow, z.dx, mode, spanX + count);
+        for (int i = count; i < count + passed; ++i)
+        {
+          float depth = zRow + z.dx * spanX[i];
+          float w = 1.0f / depth;
+          spanU[i] = (uRow + u.dx * spanX[i]) * w;
+          spanV[i] = (vRow + v.dx * spanX[i]) * w;
+          if (i == 0) lod = levelOfDetail(z, u, v, depth, spanU[0], spanV[0], textureWidth, textureHeight);
+        }
+        count += passed;
+        written += passed;
+        x += run;
+
+        if (count == TEXTURE_SPAN || (x > last && count > 0))
+        {
+          PROFILE_SCOPE(STAGE_TEXTURE);
+          texture.sampleSpan(spanU, spanV, count, lod, filter, address, spanColour);
+          for (int i = 0; i < count; ++i) frame.pixels[row + spanX[i]] = spanColour[i];
+          count = 0;
+        }
+      }
+    }
+
+    rowW0 += t.stepY0;
+    rowW1 += t.stepY1;
+    rowW2 += t.stepY2;
+  }
+
+  PROFILE_COUNT(COUNT_TRIANGLES_RASTERIZED, 1);
+  PROFILE_COUNT(COUNT_PIXELS_TESTED, tested);
+  PROFILE_COUNT(COUNT_PIXELS_WRITTEN, written);
+  if (mode != DEPTH_EQUAL) updateBlocks(t, z, frame);
+  frame.markDirty(t.minX, t.minY, t.maxX, t.maxY);
+}
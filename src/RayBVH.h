@@ -0,0 +1,434 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <inttypes.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Bounds.h"
+#include "Mesh.h"
+
+// Leaves are only split while the surface area heuristic says it pays,
+// and always once they hold more than this many triangles.
+#define RAY_MAX_LEAF_SIZE 8
+
+// Nodes deeper than this are halved at the median rather than split by the
+// heuristic, which can be lopsided without limit. Halving takes at most 28
+// more levels to bring any mesh's leaves down to RAY_MAX_LEAF_SIZE, so no
+// leaf is deeper than RAY_STACK_SIZE - 4.
+#define RAY_MAX_SAH_DEPTH 32
+
+// Node indices a traversal can have waiting, one more than the deepest leaf.
+#define RAY_STACK_SIZE 64
+
+// Candidate split planes per axis when building.
+#define SAH_BINS 16
+
+// The cost of visiting a node relative to intersecting one triangle.
+#define SAH_TRAVERSAL_COST 1.0f
+
+// Rays are traced in square packets of this many a side.
+#define RAY_PACKET_WIDTH 4
+#define RAY_PACKET_SIZE (RAY_PACKET_WIDTH * RAY_PACKET_WIDTH)
+
+// Hits nearer than this along a ray are ignored.
+#define RAY_EPSILON 1e-5f
+
+// The triangle of a ray that hit nothing.
+#define RAY_MISS 0xFFFFFFFFu
+
+/**
+ * A triangle set up for Moller-Trumbore intersection: a corner and the two
+ * edges leaving it, with the index of the mesh triangle it came from.
+ */
+struct RayTriangle
+{
+    glm::vec3 v0, edge1, edge2;
+    uint32_t index;
+};
+
+/**
+ * A node of a ray tracing BVH. Inner nodes have two adjacent children and
+ * no triangles of their own.
+ */
+struct RayNode
+{
+    AABB bounds;
+
+    // The first triangle of a leaf, or the first child of an inner node.
+    uint32_t first;
+
+    // The number of triangles in a leaf, or 0 for an inner node.
+    uint32_t count;
+
+    // The axis an inner node was split along, for visiting its children nearest first.
+    uint32_t axis;
+};
+
+/**
+ * A bounding volume hierarchy for tracing rays through a mesh, split by the
+ * surface area heuristic. Its triangles are copies of the mesh's, stored in
+ * leaf order.
+ */
+struct RayBVH
+{
+    std::vector<RayNode> nodes;
+    std::vector<RayTriangle> triangles;
+};
+
+/**
+ * A packet of rays traced together through a RayBVH, stored lane by lane.
+ * Directions need not be normalized; t is measured in multiples of them.
+ */
+struct RayPacket
+{
+    float originX[RAY_PACKET_SIZE], originY[RAY_PACKET_SIZE], originZ[RAY_PACKET_SIZE];
+    float dirX[RAY_PACKET_SIZE], dirY[RAY_PACKET_SIZE], dirZ[RAY_PACKET_SIZE];
+
+    // Lanes that are not active are left alone.
+    bool active[RAY_PACKET_SIZE];
+
+    // The distance to the nearest hit so far, which limits the search.
+    float tMax[RAY_PACKET_SIZE];
+
+    // The mesh triangle hit, or RAY_MISS, with the barycentric coordinates of the hit.
+    uint32_t triangle[RAY_PACKET_SIZE];
+    float u[RAY_PACKET_SIZE], v[RAY_PACKET_SIZE];
+
+    /**
+     * Deactivates every lane, leaving harmless values in them for the
+     * traversal, which works on whole packets.
+     */
+    void clear()
+    {
+        for (int i = 0; i < RAY_PACKET_SIZE; ++i)
+        {
+            originX[i] = originY[i] = originZ[i] = 0.0f;
+            dirX[i] = dirY[i] = dirZ[i] = 1.0f;
+            active[i] = false;
+            tMax[i] = 0.0f;
+            triangle[i] = RAY_MISS;
+        }
+    }
+
+    /**
+     * Sets a lane to a ray that has not hit anything yet.
+     *
+     * @param i The lane.
+     * @param origin The start of the ray.
+     * @param dir The direction of the ray.
+     * @param length How far along dir to search.
+     */
+    void set(int i, const glm::vec3& origin, const glm::vec3& dir, float length)
+    {
+        originX[i] = origin.x;
+        originY[i] = origin.y;
+        originZ[i] = origin.z;
+        dirX[i] = dir.x;
+        dirY[i] = dir.y;
+        dirZ[i] = dir.z;
+        active[i] = true;
+        tMax[i] = length;
+        triangle[i] = RAY_MISS;
+    }
+};
+
+/**
+ * Builds a RayBVH top down with binned SAH splits.
+ */
+struct RayBVHBuilder
+{
+    RayBVH& bvh;
+    std::vector<AABB> triangleBounds;
+    std::vector<glm::vec3> centres;
+    std::vector<uint32_t> order;
+
+    RayBVHBuilder(RayBVH& bvh)
+    : bvh(bvh)
+    {}
+
+    struct Bin
+    {
+        AABB bounds;
+        uint32_t count;
+    };
+
+    void makeLeaf(uint32_t node, uint32_t first, uint32_t count)
+    {
+        bvh.nodes[node].first = first;
+        bvh.nodes[node].count = count;
+        bvh.nodes[node].axis = 0;
+    }
+
+    /**
+     * Builds a node and everything below it.
+     *
+     * @param node The node.
+     * @param first The first of the node's triangles in order.
+     * @param count The number of triangles under the node.
+     * @param depth The node's depth, 0 for the root.
+     */
+    void build(uint32_t node, uint32_t first, uint32_t count, int depth)
+    {
+        AABB bounds, centreBounds;
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            bounds.grow(triangleBounds[order[i]]);
+            centreBounds.grow(centres[order[i]]);
+        }
+        bvh.nodes[node].bounds = bounds;
+
+        // Each split is costed in triangle intersections, relative to the parent's area.
+        float leafCost = (float) count;
+        float bestCost = leafCost;
+        int bestAxis = -1, bestBin = 0;
+        glm::vec3 extent = centreBounds.extent();
+        float parentArea = bounds.surfaceArea();
+
+        for (int axis = 0; axis < 3 && count > 1 && parentArea > 0 && depth < RAY_MAX_SAH_DEPTH; ++axis)
+        {
+            if (!(extent[axis] > 0)) continue;
+            float scale = SAH_BINS / extent[axis];
+
+            Bin bins[SAH_BINS];
+            for (int b = 0; b < SAH_BINS; ++b) bins[b].count = 0;
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                uint32_t t = order[i];
+                int b = std::min(SAH_BINS - 1, (int) ((centres[t][axis] - centreBounds.min[axis]) * scale));
+                bins[b].bounds.grow(triangleBounds[t]);
+                ++bins[b].count;
+            }
+
+            // Sweep from the right to find the cost of everything after each plane.
+            float rightArea[SAH_BINS];
+            uint32_t rightCount[SAH_BINS];
+            AABB right;
+            uint32_t n = 0;
+            for (int b = SAH_BINS - 1; b > 0; --b)
+            {
+                right.grow(bins[b].bounds);
+                n += bins[b].count;
+                rightArea[b] = right.surfaceArea();
+                rightCount[b] = n;
+            }
+
+            AABB left;
+            n = 0;
+            for (int b = 0; b < SAH_BINS - 1; ++b)
+            {
+                left.grow(bins[b].bounds);
+                n += bins[b].count;
+                if (n == 0 || rightCount[b + 1] == 0) continue;
+                float cost = SAH_TRAVERSAL_COST + (left.surfaceArea() * n + rightArea[b + 1] * rightCount[b + 1]) / parentArea;
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        uint32_t leftCount;
+        if (bestAxis >= 0)
+        {
+            float scale = SAH_BINS / extent[bestAxis];
+            uint32_t* middle = std::partition(order.data() + first, order.data() + first + count, [&](uint32_t t)
+            {
+                return std::min(SAH_BINS - 1, (int) ((centres[t][bestAxis] - centreBounds.min[bestAxis]) * scale)) <= bestBin;
+            });
+            leftCount = middle - (order.data() + first);
+        }
+        else if (count > RAY_MAX_LEAF_SIZE)
+        {
+            // Nothing is gained by splitting, or the tree is too deep to keep to the heuristic, but the leaf is too big: halve it.
+            bestAxis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+            uint32_t* begin = order.data() + first;
+            std::nth_element(begin, begin + count / 2, begin + count, [&](uint32_t a, uint32_t b)
+            {
+                return centres[a][bestAxis] < centres[b][bestAxis];
+            });
+            leftCount = count / 2;
+        }
+        else
+        {
+            makeLeaf(node, first, count);
+            return;
+        }
+
+        uint32_t left = bvh.nodes.size();
+        bvh.nodes.push_back(RayNode());
+        bvh.nodes.push_back(RayNode());
+        bvh.nodes[node].first = left;
+        bvh.nodes[node].count = 0;
+        bvh.nodes[node].axis = bestAxis;
+        build(left, first, leftCount, depth + 1);
+        build(left + 1, first + leftCount, count - leftCount, depth + 1);
+    }
+};
+
+/**
+ * Builds a ray tracing BVH over the triangles of a mesh.
+ *
+ * @param mesh The mesh. The BVH refers back to it by triangle index.
+ * @return The hierarchy. It has no nodes if the mesh has no triangles.
+ */
+RayBVH buildRayBVH(const MeshView& mesh)
+{
+    RayBVH bvh;
+    if (mesh.triangleCount == 0) return bvh;
+
+    RayBVHBuilder builder(bvh);
+    builder.triangleBounds.resize(mesh.triangleCount);
+    builder.centres.resize(mesh.triangleCount);
+    builder.order.resize(mesh.triangleCount);
+    for (int i = 0; i < mesh.triangleCount; ++i)
+    {
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            uint32_t v = mesh.indices[3 * i + corner];
+            builder.triangleBounds[i].grow(glm::vec3(mesh.x[v], mesh.y[v], mesh.z[v]));
+        }
+        builder.centres[i] = builder.triangleBounds[i].centre();
+        builder.order[i] = i;
+    }
+
+    bvh.nodes.reserve(2 * mesh.triangleCount);
+    bvh.nodes.push_back(RayNode());
+    builder.build(0, 0, mesh.triangleCount, 0);
+
+    bvh.triangles.resize(mesh.triangleCount);
+    for (int i = 0; i < mesh.triangleCount; ++i)
+    {
+        const uint32_t* corners = mesh.indices + 3 * builder.order[i];
+        glm::vec3 p[3];
+        for (int k = 0; k < 3; ++k) p[k] = glm::vec3(mesh.x[corners[k]], mesh.y[corners[k]], mesh.z[corners[k]]);
+
+        RayTriangle& t = bvh.triangles[i];
+        t.v0 = p[0];
+        t.edge1 = p[1] - p[0];
+        t.edge2 = p[2] - p[0];
+        t.index = builder.order[i];
+    }
+    return bvh;
+}
+
+/**
+ * The reciprocal directions of a packet, worked out once per traversal for the slab tests.
+ */
+struct PacketSlabs
+{
+    float invX[RAY_PACKET_SIZE], invY[RAY_PACKET_SIZE], invZ[RAY_PACKET_SIZE];
+
+    PacketSlabs(const RayPacket& packet)
+    {
+        for (int i = 0; i < RAY_PACKET_SIZE; ++i)
+        {
+            invX[i] = 1.0f / packet.dirX[i];
+            invY[i] = 1.0f / packet.dirY[i];
+            invZ[i] = 1.0f / packet.dirZ[i];
+        }
+    }
+
+    /**
+     * @return True if any active ray of the packet enters the box before its tMax.
+     */
+    bool anyHit(const RayPacket& packet, const AABB& box) const
+    {
+        bool any = false;
+        for (int i = 0; i < RAY_PACKET_SIZE; ++i)
+        {
+            float x0 = (box.min.x - packet.originX[i]) * invX[i], x1 = (box.max.x - packet.originX[i]) * invX[i];
+            float y0 = (box.min.y - packet.originY[i]) * invY[i], y1 = (box.max.y - packet.originY[i]) * invY[i];
+            float z0 = (box.min.z - packet.originZ[i]) * invZ[i], z1 = (box.max.z - packet.originZ[i]) * invZ[i];
+            float enter = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::max(std::min(z0, z1), 0.0f));
+            float leave = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::min(std::max(z0, z1), packet.tMax[i]));
+            any |= packet.active[i] && enter <= leave;
+        }
+        return any;
+    }
+};
+
+/**
+ * Intersects every active ray of a packet with one triangle, Moller-Trumbore
+ * style, recording hits nearer than the ray's tMax.
+ *
+ * @param t The triangle.
+ * @param packet The rays.
+ * @param anyHit Whether a hit also deactivates its ray, for shadow rays that need no nearest hit.
+ * @return True if every ray of the packet is now inactive.
+ */
+inline bool intersectTriangle(const RayTriangle& t, RayPacket& packet, bool anyHit)
+{
+    bool done = true;
+    for (int i = 0; i < RAY_PACKET_SIZE; ++i)
+    {
+        glm::vec3 dir(packet.dirX[i], packet.dirY[i], packet.dirZ[i]);
+        glm::vec3 p = glm::cross(dir, t.edge2);
+        float det = glm::dot(t.edge1, p);
+        float invDet = 1.0f / det;
+
+        glm::vec3 s = glm::vec3(packet.originX[i], packet.originY[i], packet.originZ[i]) - t.v0;
+        float u = glm::dot(s, p) * invDet;
+        glm::vec3 q = glm::cross(s, t.edge1);
+        float v = glm::dot(dir, q) * invDet;
+        float distance = glm::dot(t.edge2, q) * invDet;
+
+        // Rays in the triangle's plane have det = 0 and fail on the NaNs and infinities that follow.
+        bool hit = packet.active[i] && u >= 0 && v >= 0 && u + v <= 1 && distance > RAY_EPSILON && distance < packet.tMax[i];
+        if (hit)
+        {
+            packet.tMax[i] = distance;
+            packet.triangle[i] = t.index;
+            packet.u[i] = u;
+            packet.v[i] = v;
+            packet.active[i] = !anyHit;
+        }
+        done = done && !packet.active[i];
+    }
+    return done;
+}
+
+/**
+ * Traces a packet through a BVH, visiting each node once for all of its
+ * rays. Children are visited nearest first along the packet's direction,
+ * so far subtrees are often skipped once every ray has a nearer hit.
+ *
+ * @param bvh The hierarchy.
+ * @param packet The rays. Each active ray ends with the nearest hit within its tMax.
+ * @param anyHit Stop each ray at the first hit found rather than the nearest. The
+ *               rays that hit something are left inactive.
+ */
+void tracePacket(const RayBVH& bvh, RayPacket& packet, bool anyHit = false)
+{
+    int lead = 0;
+    while (lead < RAY_PACKET_SIZE && !packet.active[lead]) ++lead;
+    if (lead == RAY_PACKET_SIZE || bvh.nodes.empty()) return;
+
+    const float* leadDir[3] = {packet.dirX, packet.dirY, packet.dirZ};
+    PacketSlabs slabs(packet);
+
+    // The build bounds the depth, so the stack never holds more than a node per level plus one.
+    uint32_t stack[RAY_STACK_SIZE];
+    int size = 0;
+    stack[size++] = 0;
+    while (size > 0)
+    {
+        const RayNode& node = bvh.nodes[stack[--size]];
+        if (!slabs.anyHit(packet, node.bounds)) continue;
+
+        if (node.count > 0)
+        {
+            for (uint32_t k = node.first; k < node.first + node.count; ++k)
+            {
+                if (intersectTriangle(bvh.triangles[k], packet, anyHit)) return;
+            }
+            continue;
+        }
+
+        bool backwards = leadDir[node.axis][lead] < 0;
+        stack[size++] = node.first + (backwards ? 0 : 1);
+        stack[size++] = node.first + (backwards ? 1 : 0);
+    }
+}
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <inttypes.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+#include <glm/glm.hpp>
+#include "FrameBuffer.h"
+#include "Mesh.h"
+#include "PixelUtil.h"
+#include "Profiler.h"
+#include "RayBVH.h"
+#include "Texture.h"
+#include "ThreadPool.h"
+
+#define RAY_TILE_SIZE 32
+
+// Rays per pixel path: the camera ray and up to two reflections.
+#define RAY_MAX_DEPTH 3
+
+// Secondary rays start this far off the surface they leave, so they do not hit it again.
+#define RAY_SURFACE_OFFSET 1e-3f
+
+/**
+ * A light that shines equally in every direction from a point, falling off
+ * with the square of the distance.
+ */
+struct PointLight
+{
+  glm::vec3 position;
+  float power;
+};
+
+/**
+ * Renders a mesh by tracing rays from the camera, with hard shadows from a
+ * point light and mirror reflections.
+ *
+ * The frame is split into square tiles spread across a thread pool, and
+ * each tile is traced in packets of neighbouring rays that walk an SAH BVH
+ * together. Pixels take the same camera, projection and depth convention
+ * as the rasterizer, so the two can be swapped between frames.
+ */
+class RayTracer
+{
+private:
+  ThreadPool& pool;
+  MeshView scene;
+  const Texture* texture;
+  RayBVH bvh;
+  std::vector<float> reflectivity;
+  PointLight light;
+  float ambient;
+  glm::vec3 background;
+
+  static glm::vec3 unpack(uint32_t colour)
+  {
+    return glm::vec3((colour >> 16) & 255, (colour >> 8) & 255, colour & 255) / 255.0f;
+  }
+
+  glm::vec3 albedo(uint32_t triangle, float u, float v) const
+  {
+    uint32_t material = scene.materialIds[triangle];
+    if (texture != NULL && !texture->isEmpty() && scene.texCoordIndices != NULL && (scene.materialFlags[material] & MATERIAL_TEXTURED))
+    {
+      // As in the rasterizer, OBJ texture coordinates start at the bottom of the image.
+      const uint32_t* t = scene.texCoordIndices + 3 * triangle;
+      if (t[0] != NO_INDEX && t[1] != NO_INDEX && t[2] != NO_INDEX)
+      {
+        float w = 1.0f - u - v;
+        float s = w * scene.u[t[0]] + u * scene.u[t[1]] + v * scene.u[t[2]];
+        float r = 1.0f - (w * scene.v[t[0]] + u * scene.v[t[1]] + v * scene.v[t[2]]);
+        return unpack(texture->sample(s, r, 0.0f, TEXTURE_BILINEAR, TEXTURE_WRAP));
+      }
+    }
+    return unpack(scene.colours[material]);
+  }
+
+  /**
+   * Traces a packet and works out the colour each of its rays sees.
+   *
+   * @param packet The rays, which are traced in place.
+   * @param depth How many bounces the packet is from the camera.
+   * @param colour Receives the colour of every active ray.
+   */
+  void shade(RayPacket& packet, int depth, glm::vec3 colour[RAY_PACKET_SIZE]) const
+  {
+    bool traced[RAY_PACKET_SIZE];
+    for (int i = 0; i < RAY_PACKET_SIZE; ++i) traced[i] = packet.active[i];
+    tracePacket(bvh, packet);
+
+    // Shadow rays run from each hit to the light and only need to know if anything is in the way.
+    RayPacket shadow;
+    shadow.clear();
+    glm::vec3 point[RAY_PACKET_SIZE], normal[RAY_PACKET_SIZE];
+    for (int i = 0; i < RAY_PACKET_SIZE; ++i)
+    {
+      if (!traced[i]) continue;
+      if (packet.triangle[i] == RAY_MISS)
+      {
+        colour[i] = background;
+        continue;
+      }
+
+      glm::vec3 dir(packet.dirX[i], packet.dirY[i], packet.dirZ[i]);
+      point[i] = glm::vec3(packet.originX[i], packet.originY[i], packet.originZ[i]) + dir * packet.tMax[i];
+
+      // Surfaces are lit from whichever side the ray arrives at.
+      const uint32_t* corners = scene.indices + 3 * packet.triangle[i];
+      glm::vec3 p0(scene.x[corners[0]], scene.y[corners[0]], scene.z[corners[0]]);
+      glm::vec3 p1(scene.x[corners[1]], scene.y[corners[1]], scene.z[corners[1]]);
+      glm::vec3 p2(scene.x[corners[2]], scene.y[corners[2]], scene.z[corners[2]]);
+      normal[i] = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+      if (glm::dot(normal[i], dir) > 0) normal[i] = -normal[i];
+
+      glm::vec3 origin = point[i] + normal[i] * RAY_SURFACE_OFFSET;
+      shadow.set(i, origin, light.position - origin, 1.0f);
+    }
+    tracePacket(bvh, shadow, true);
+
+    RayPacket reflected;
+    reflected.clear();
+    float mirror[RAY_PACKET_SIZE];
+    bool bounced[RAY_PACKET_SIZE];
+    bool bounce = false;
+    for (int i = 0; i < RAY_PACKET_SIZE; ++i)
+    {
+      mirror[i] = 0.0f;
+      bounced[i] = false;
+      if (!traced[i] || packet.triangle[i] == RAY_MISS) continue;
+
+      float intensity = ambient;
+      if (shadow.triangle[i] == RAY_MISS)
+      {
+        glm::vec3 toLight(shadow.dirX[i], shadow.dirY[i], shadow.dirZ[i]);
+        float distanceSquared = glm::dot(toLight, toLight);
+        float facing = glm::dot(normal[i], toLight) / std::sqrt(distanceSquared);
+        if (facing > 0) intensity += light.power * facing / (4.0f * (float) M_PI * distanceSquared);
+      }
+      colour[i] = albedo(packet.triangle[i], packet.u[i], packet.v[i]) * std::min(intensity, 1.0f);
+
+      mirror[i] = reflectivity[scene.materialIds[packet.triangle[i]]];
+      if (mirror[i] > 0 && depth + 1 < RAY_MAX_DEPTH)
+      {
+        glm::vec3 dir(packet.dirX[i], packet.dirY[i], packet.dirZ[i]);
+        reflected.set(i, point[i] + normal[i] * RAY_SURFACE_OFFSET, glm::reflect(glm::normalize(dir), normal[i]), FLT_MAX);
+        bounced[i] = bounce = true;
+      }
+    }
+    if (!bounce) return;
+
+    glm::vec3 seen[RAY_PACKET_SIZE];
+    shade(reflected, depth + 1, seen);
+    for (int i = 0; i < RAY_PACKET_SIZE; ++i)
+    {
+      if (bounced[i]) colour[i] = colour[i] * (1.0f - mirror[i]) + seen[i] * mirror[i];
+    }
+  }
+
+public:
+  RayTracer(ThreadPool& pool)
+  : pool(pool)
+  , texture(NULL)
+  , ambient(0.2f)
+  , background(0.0f)
+  {
+    light.position = glm::vec3(0.0f);
+    light.power = 0.0f;
+  }
+
+  /**
+   * Builds the BVH for a mesh. Every material starts out matte.
+   *
+   * @param mesh The mesh, which must outlive the tracer or the next call.
+   * @param diffuse The texture textured materials sample, or NULL or an empty texture to use their colour.
+   */
+  void setScene(const MeshView& mesh, const Texture* diffuse)
+  {
+    scene = mesh;
+    texture = diffuse;
+    bvh = buildRayBVH(mesh);
+    reflectivity.assign(mesh.materialCount, 0.0f);
+  }
+
+  void setLight(const PointLight& pointLight, float ambientLight)
+  {
+    light = pointLight;
+    ambient = ambientLight;
+  }
+
+  /**
+   * Makes a material partly or wholly a mirror.
+   *
+   * @param material The index of the material.
+   * @param amount The fraction of its colour that is reflected, from 0 for matte to 1 for a perfect mirror.
+   */
+  void setReflectivity(int material, float amount)
+  {
+    reflectivity[material] = amount;
+  }
+
+  /**
+   * Traces a frame, in parallel. Pixels whose camera ray hits nothing keep
+   * the clear colour and an infinitely far depth.
+   *
+   * @param frame The frame buffer to draw into. Its size is the image size.
+   * @param clearColour A bitpacked ARGB colour, also seen by reflections that leave the scene.
+   * @param cameraToWorld A 4x4 affine matrix that maps points from the camera space to the world space.
+   * @param focalLength The focal length of the camera.
+   * @param canvasWidth The width of the canvas points are projected to in scale relative to values in world space.
+   * @param canvasHeight The height of the canvas points are projected to in scale relative to values in world space.
+   */
+  void render(FrameBuffer& frame, uint32_t clearColour, const glm::mat4x4& cameraToWorld,
+              float focalLength, float canvasWidth, float canvasHeight)
+  {
+    PROFILE_SCOPE(STAGE_RAY_TRACE);
+    background = unpack(clearColour);
+
+    // The inverse of project2D: pixel (x, y) looks along camera space (a, b, -1) with
+    // a and b linear in x and y. Leaving that unnormalized makes t the camera space depth.
+    glm::vec3 origin(cameraToWorld[3]);
+    glm::vec3 stepX = glm::vec3(cameraToWorld[0]) * (canvasWidth / (frame.width * focalLength));
+    glm::vec3 stepY = glm::vec3(cameraToWorld[1]) * (-canvasHeight / (frame.height * focalLength));
+    glm::vec3 corner = glm::vec3(cameraToWorld[0]) * (-canvasWidth / (2.0f * focalLength)) +
+                       glm::vec3(cameraToWorld[1]) * (canvasHeight / (2.0f * focalLength)) - glm::vec3(cameraToWorld[2]);
+
+    // Every pixel is written, and ray tiles are smaller than the frame's clear tiles, so mark them all here rather than from the jobs.
+    frame.markDirty();
+    int tilesX = (frame.width + RAY_TILE_SIZE - 1) / RAY_TILE_SIZE;
+    int tilesY = (frame.height + RAY_TILE_SIZE - 1) / RAY_TILE_SIZE;
+    pool.parallelFor(tilesX * tilesY, [&](int tile)
+    {
+      int x0 = (tile % tilesX) * RAY_TILE_SIZE;
+      int y0 = (tile / tilesX) * RAY_TILE_SIZE;
+      int x1 = std::min(x0 + RAY_TILE_SIZE, frame.width) - 1;
+      int y1 = std::min(y0 + RAY_TILE_SIZE, frame.height) - 1;
+      frame.clearRect(x0, y0, x1, y1, clearColour);
+
+      for (int py = y0; py <= y1; py += RAY_PACKET_WIDTH)
+      {
+        for (int px = x0; px <= x1; px += RAY_PACKET_WIDTH)
+        {
+          RayPacket packet;
+          packet.clear();
+          for (int i = 0; i < RAY_PACKET_SIZE; ++i)
+          {
+            int x = px + i % RAY_PACKET_WIDTH, y = py + i / RAY_PACKET_WIDTH;
+            if (x <= x1 && y <= y1) packet.set(i, origin, corner + stepX * (x + 0.5f) + stepY * (y + 0.5f), FLT_MAX);
+          }
+
+          glm::vec3 colour[RAY_PACKET_SIZE];
+          shade(packet, 0, colour);
+
+          for (int i = 0; i < RAY_PACKET_SIZE; ++i)
+          {
+            if (!packet.active[i] || packet.triangle[i] == RAY_MISS) continue;
+            int index = (px + i % RAY_PACKET_WIDTH) + frame.width * (py + i / RAY_PACKET_WIDTH);
+            glm::vec3 c = glm::min(colour[i], glm::vec3(1.0f)) * 255.0f + 0.5f;
+            frame.pixels[index] = packRGB((int) c.x, (int) c.y, (int) c.z);
+            frame.depth[index] = 1.0f / packet.tMax[i];
+          }
+        }
+      }
+    });
+  }
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <DrawingWindow.h>
+#include "FrameBuffer.h"
+#include "ImageIO.h"
+
+/**
+ * Somewhere a finished frame can be sent once it has been rasterized.
+ *
+ * Presenting is split in two so that it can overlap drawing the next
+ * frame: present() does the heavy work and may run on any thread, one
+ * frame at a time, while show() does whatever must happen on the main
+ * thread once present() has returned.
+ */
+class RenderTarget
+{
+public:
+  virtual ~RenderTarget() {}
+
+  /**
+   * Copies out or stores a finished frame.
+   *
+   * @param frame The frame buffer holding the rendered frame.
+   */
+  virtual void present(const FrameBuffer& frame) = 0;
+
+  /**
+   * Displays the frame last handed to present(). Called from the main thread.
+   */
+  virtual void show() {}
+};
+
+/**
+ * Presents frames to an SDL window: present() copies them into the
+ * window's pixels and show() puts those on the screen.
+ */
+class WindowTarget : public RenderTarget
+{
+private:
+  DrawingWindow& window;
+
+public:
+  WindowTarget(DrawingWindow& window)
+  : window(window)
+  {}
+
+  void present(const FrameBuffer& frame)
+  {
+    for (int y = 0; y < frame.height; ++y)
+    {
+      for (int x = 0; x < frame.width; ++x)
+      {
+        window.setPixelColour(x, y, frame.getPixel(x, y));
+      }
+    }
+  }
+
+  void show()
+  {
+    window.renderFrame();
+  }
+};
+
+/**
+ * Writes frames to numbered files on disk so the renderer can run without a display.
+ */
+class HeadlessTarget : public RenderTarget
+{
+public:
+  enum Format { PPM, RAW };
+
+private:
+  std::string prefix;
+  Format format;
+  int frameNumber;
+
+public:
+  /**
+   * @param prefix Path prefix of the output files, e.g. "frames/frame" gives "frames/frame00000.ppm".
+   * @param format PPM writes binary P6 images, RAW dumps the packed ARGB buffer as is.
+   */
+  HeadlessTarget(const std::string& prefix, Format format)
+  : prefix(prefix)
+  , format(format)
+  , frameNumber(0)
+  {}
+
+  void present(const FrameBuffer& frame)
+  {
+    char fileName[512];
+    snprintf(fileName, sizeof(fileName), "%s%05d.%s", prefix.c_str(), frameNumber++, format == PPM ? "ppm" : "raw");
+
+    if (format == PPM)
+    {
+      savePPM(fileName, frame.pixels, frame.width, frame.height);
+    }
+    else
+    {
+      FILE* fptr = fopen(fileName, "wb");
+      if (fptr == NULL) return;
+      fwrite(frame.pixels, sizeof(uint32_t), frame.width * frame.height, fptr);
+      fclose(fptr);
+    }
+  }
+};
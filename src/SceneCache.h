@@ -0,0 +1,364 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include "Image.h"
+#include "MappedFile.h"
+#include "Mesh.h"
+
+/*
+ * Binary scene cache layout, all values in native byte order:
+ *
+ *   SceneCacheHeader
+ *   SourceStamp[sourceCount]     files the scene was built from
+ *   CacheBlock[blockCount]       table of contents
+ *   blocks, each starting on a CACHE_ALIGNMENT byte boundary
+ *
+ * The blocks are plain arrays laid out exactly as the renderer reads them,
+ * so a mapped cache is used in place without parsing or copying.
+ */
+
+#define SCENE_CACHE_MAGIC "GFXSCENE"
+#define SCENE_CACHE_VERSION 4
+#define SCENE_CACHE_BYTE_ORDER 0x01020304u
+#define CACHE_ALIGNMENT 64
+
+enum CacheBlockType
+{
+    BLOCK_POSITIONS_X,
+    BLOCK_POSITIONS_Y,
+    BLOCK_POSITIONS_Z,
+    BLOCK_INDICES,
+    BLOCK_MATERIAL_IDS,
+    BLOCK_MATERIAL_COLOURS,
+    BLOCK_TEXTURE,
+    BLOCK_MATERIAL_FLAGS,
+    BLOCK_TEXCOORDS_U,
+    BLOCK_TEXCOORDS_V,
+    BLOCK_TEXCOORD_INDICES,
+    BLOCK_OBJECT_STARTS,
+    BLOCK_TYPE_COUNT
+};
+
+struct SceneCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    float scaleFactor;
+    uint32_t sourceCount;
+    uint32_t blockCount;
+    uint32_t textureWidth;
+    uint32_t textureHeight;
+    uint32_t reserved;
+};
+
+struct SourceStamp
+{
+    char path[256];
+    uint64_t size;
+    int64_t mtime;
+    int64_t mtimeNanoseconds;
+
+    // The inode's change time, which writes and touch -r both move on, but which nothing can set back.
+    int64_t ctime;
+    int64_t ctimeNanoseconds;
+
+    // When the stamp was taken, in seconds.
+    int64_t stamped;
+    uint64_t hash;
+};
+
+struct CacheBlock
+{
+    uint32_t type;
+    uint32_t count;
+    uint64_t offset;
+    uint64_t size;
+};
+
+/**
+ * 64-bit FNV-1a hash of a whole file.
+ *
+ * @param fileName The file to hash.
+ * @return The hash, or 0 if the file could not be read.
+ */
+uint64_t hashFile(const char* fileName)
+{
+    MappedFile file(fileName);
+    if (!file.isOpen()) return 0;
+
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char* p = file.begin(); p < file.end(); ++p)
+    {
+        hash ^= (unsigned char) *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @return The nanoseconds part of a file's modification time, or 0 where the filesystem does not keep them.
+ */
+inline int64_t modificationNanoseconds(const struct stat& info)
+{
+#if defined(__APPLE__)
+    return info.st_mtimespec.tv_nsec;
+#else
+    return info.st_mtim.tv_nsec;
+#endif
+}
+
+/**
+ * @return The nanoseconds part of a file's change time, or 0 where the filesystem does not keep them.
+ */
+inline int64_t changeNanoseconds(const struct stat& info)
+{
+#if defined(__APPLE__)
+    return info.st_ctimespec.tv_nsec;
+#else
+    return info.st_ctim.tv_nsec;
+#endif
+}
+
+/**
+ * Records the current size, modification time and contents hash of a file.
+ */
+bool stampSource(const std::string& fileName, SourceStamp& stamp)
+{
+    struct stat info;
+    if (fileName.size() >= sizeof(stamp.path) || stat(fileName.c_str(), &info) != 0) return false;
+
+    memset(&stamp, 0, sizeof(stamp));
+    strcpy(stamp.path, fileName.c_str());
+    stamp.size = info.st_size;
+    stamp.mtime = info.st_mtime;
+    stamp.mtimeNanoseconds = modificationNanoseconds(info);
+    stamp.ctime = info.st_ctime;
+    stamp.ctimeNanoseconds = changeNanoseconds(info);
+    stamp.stamped = time(NULL);
+    stamp.hash = hashFile(fileName.c_str());
+    return true;
+}
+
+/**
+ * Whether a source file still matches its stamp. Size and the modification
+ * and change times, to the nanosecond, are checked first. The file is only
+ * hashed when a time has changed, or when it was stamped in the same second
+ * it last changed, since an edit later in that second may leave the times
+ * as they were on filesystems that keep whole seconds.
+ */
+bool sourceUnchanged(const SourceStamp& stamp)
+{
+    struct stat info;
+    if (stat(stamp.path, &info) != 0) return false;
+    if ((uint64_t) info.st_size != stamp.size) return false;
+    bool sameTime = info.st_mtime == stamp.mtime && modificationNanoseconds(info) == stamp.mtimeNanoseconds &&
+                    info.st_ctime == stamp.ctime && changeNanoseconds(info) == stamp.ctimeNanoseconds;
+    if (sameTime && stamp.stamped > stamp.ctime) return true;
+    return hashFile(stamp.path) == stamp.hash;
+}
+
+/**
+ * Writes a scene cache built from a loaded mesh and texture.
+ *
+ * @param cachePath The location of the cache file to write.
+ * @param mesh The loaded mesh. Its sources are recorded for invalidation.
+ * @param scaleFactor The scale factor the mesh was loaded with.
+ * @param texture The loaded texture.
+ * @param texturePath The file the texture was loaded from.
+ * @return Whether the cache was written.
+ */
+bool writeSceneCache(const char* cachePath, const Mesh& mesh, float scaleFactor, const Image& texture, const char* texturePath)
+{
+    std::vector<SourceStamp> stamps;
+    std::vector<std::string> sources = mesh.sources;
+    sources.push_back(texturePath);
+    for (const std::string& source : sources)
+    {
+        SourceStamp stamp;
+        if (!stampSource(source, stamp)) return false;
+        stamps.push_back(stamp);
+    }
+
+    const void* data[BLOCK_TYPE_COUNT] = {
+        mesh.positions.x.data(), mesh.positions.y.data(), mesh.positions.z.data(),
+        mesh.indices.data(), mesh.materialIds.data(), mesh.materials.colours.data(), texture.getPayload(),
+        mesh.materials.flags.data(), mesh.texCoords.u.data(), mesh.texCoords.v.data(), mesh.texCoordIndices.data(),
+        mesh.objectStarts.data()
+    };
+    uint32_t counts[BLOCK_TYPE_COUNT] = {
+        (uint32_t) mesh.positions.size(), (uint32_t) mesh.positions.size(), (uint32_t) mesh.positions.size(),
+        (uint32_t) mesh.indices.size(), (uint32_t) mesh.materialIds.size(), (uint32_t) mesh.materials.size(),
+        (uint32_t) (texture.getWidth() * texture.getHeight()),
+        (uint32_t) mesh.materials.size(), (uint32_t) mesh.texCoords.size(), (uint32_t) mesh.texCoords.size(),
+        (uint32_t) mesh.texCoordIndices.size(), (uint32_t) mesh.objectStarts.size()
+    };
+    size_t elementSize = sizeof(uint32_t); // Every block holds 4-byte floats or integers.
+
+    SceneCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic));
+    header.version = SCENE_CACHE_VERSION;
+    header.byteOrder = SCENE_CACHE_BYTE_ORDER;
+    header.scaleFactor = scaleFactor;
+    header.sourceCount = stamps.size();
+    header.blockCount = BLOCK_TYPE_COUNT;
+    header.textureWidth = texture.getWidth();
+    header.textureHeight = texture.getHeight();
+
+    CacheBlock blocks[BLOCK_TYPE_COUNT];
+    uint64_t offset = sizeof(header) + stamps.size() * sizeof(SourceStamp) + sizeof(blocks);
+    for (int i = 0; i < BLOCK_TYPE_COUNT; ++i)
+    {
+        offset = (offset + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+        blocks[i].type = i;
+        blocks[i].count = counts[i];
+        blocks[i].offset = offset;
+        blocks[i].size = counts[i] * elementSize;
+        offset += blocks[i].size;
+    }
+
+    // Write to a temporary file and rename, so a reader never maps a half written cache.
+    std::string temporaryPath = std::string(cachePath) + ".tmp";
+    FILE* fptr = fopen(temporaryPath.c_str(), "wb");
+    if (fptr == NULL) return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, fptr) == 1;
+    if (!stamps.empty()) ok = ok && fwrite(stamps.data(), sizeof(SourceStamp), stamps.size(), fptr) == stamps.size();
+    ok = ok && fwrite(blocks, sizeof(blocks), 1, fptr) == 1;
+
+    static const char padding[CACHE_ALIGNMENT] = {0};
+    for (int i = 0; i < BLOCK_TYPE_COUNT && ok; ++i)
+    {
+        long position = ftell(fptr);
+        ok = fwrite(padding, 1, blocks[i].offset - position, fptr) == blocks[i].offset - position;
+        if (blocks[i].size > 0) ok = ok && fwrite(data[i], 1, blocks[i].size, fptr) == blocks[i].size;
+    }
+
+    ok = fclose(fptr) == 0 && ok;
+    if (!ok || rename(temporaryPath.c_str(), cachePath) != 0)
+    {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * A memory-mapped scene cache. The mesh and texture are used directly from the mapping.
+ */
+class SceneCache
+{
+private:
+    MappedFile file;
+    bool valid;
+    MeshView meshView;
+    Image textureView;
+
+    const CacheBlock* findBlock(const CacheBlock* blocks, uint32_t blockCount, uint32_t type) const
+    {
+        for (uint32_t i = 0; i < blockCount; ++i)
+        {
+            if (blocks[i].type == type && blocks[i].offset + blocks[i].size <= file.getSize()) return &blocks[i];
+        }
+        return NULL;
+    }
+
+public:
+    /**
+     * Maps a cache file and checks it is complete, current and was built with the same scale factor.
+     *
+     * @param cachePath The location of the cache file.
+     * @param scaleFactor The scale factor the scene is wanted at.
+     */
+    SceneCache(const char* cachePath, float scaleFactor)
+    : file(cachePath)
+    , valid(false)
+    {
+        if (!file.isOpen() || file.getSize() < sizeof(SceneCacheHeader)) return;
+
+        const SceneCacheHeader* header = (const SceneCacheHeader*) file.begin();
+        if (memcmp(header->magic, SCENE_CACHE_MAGIC, sizeof(header->magic)) != 0) return;
+        if (header->version != SCENE_CACHE_VERSION || header->byteOrder != SCENE_CACHE_BYTE_ORDER) return;
+        if (header->scaleFactor != scaleFactor) return;
+
+        size_t tableEnd = sizeof(SceneCacheHeader) + header->sourceCount * sizeof(SourceStamp) + header->blockCount * sizeof(CacheBlock);
+        if (file.getSize() < tableEnd) return;
+
+        const SourceStamp* stamps = (const SourceStamp*) (file.begin() + sizeof(SceneCacheHeader));
+        for (uint32_t i = 0; i < header->sourceCount; ++i)
+        {
+            if (!sourceUnchanged(stamps[i])) return;
+        }
+
+        const CacheBlock* blocks = (const CacheBlock*) (stamps + header->sourceCount);
+        const CacheBlock* found[BLOCK_TYPE_COUNT];
+        for (int i = 0; i < BLOCK_TYPE_COUNT; ++i)
+        {
+            found[i] = findBlock(blocks, header->blockCount, i);
+            if (found[i] == NULL) return;
+        }
+
+        if (found[BLOCK_POSITIONS_Y]->count != found[BLOCK_POSITIONS_X]->count) return;
+        if (found[BLOCK_POSITIONS_Z]->count != found[BLOCK_POSITIONS_X]->count) return;
+        if (found[BLOCK_INDICES]->count != 3 * found[BLOCK_MATERIAL_IDS]->count) return;
+        if (found[BLOCK_MATERIAL_FLAGS]->count != found[BLOCK_MATERIAL_COLOURS]->count) return;
+        if (found[BLOCK_TEXCOORDS_V]->count != found[BLOCK_TEXCOORDS_U]->count) return;
+
+        // Texture coordinate indices are either absent or one per corner.
+        uint32_t texCoordIndexCount = found[BLOCK_TEXCOORD_INDICES]->count;
+        if (texCoordIndexCount != 0 && texCoordIndexCount != found[BLOCK_INDICES]->count) return;
+
+        const char* base = file.begin();
+        meshView.x = (const float*) (base + found[BLOCK_POSITIONS_X]->offset);
+        meshView.y = (const float*) (base + found[BLOCK_POSITIONS_Y]->offset);
+        meshView.z = (const float*) (base + found[BLOCK_POSITIONS_Z]->offset);
+        meshView.vertexCount = found[BLOCK_POSITIONS_X]->count;
+        meshView.indices = (const uint32_t*) (base + found[BLOCK_INDICES]->offset);
+        meshView.materialIds = (const uint32_t*) (base + found[BLOCK_MATERIAL_IDS]->offset);
+        meshView.triangleCount = found[BLOCK_MATERIAL_IDS]->count;
+        meshView.colours = (const uint32_t*) (base + found[BLOCK_MATERIAL_COLOURS]->offset);
+        meshView.materialFlags = (const uint32_t*) (base + found[BLOCK_MATERIAL_FLAGS]->offset);
+        meshView.materialCount = found[BLOCK_MATERIAL_COLOURS]->count;
+
+        bool textured = texCoordIndexCount != 0;
+        meshView.u = textured ? (const float*) (base + found[BLOCK_TEXCOORDS_U]->offset) : NULL;
+        meshView.v = textured ? (const float*) (base + found[BLOCK_TEXCOORDS_V]->offset) : NULL;
+        meshView.texCoordIndices = textured ? (const uint32_t*) (base + found[BLOCK_TEXCOORD_INDICES]->offset) : NULL;
+        meshView.texCoordCount = textured ? found[BLOCK_TEXCOORDS_U]->count : 0;
+
+        meshView.objectStarts = (const uint32_t*) (base + found[BLOCK_OBJECT_STARTS]->offset);
+        meshView.objectCount = found[BLOCK_OBJECT_STARTS]->count;
+        for (int i = 0; i < meshView.objectCount; ++i)
+        {
+            if (meshView.objectStarts[i] > (uint32_t) meshView.triangleCount) return;
+            if (i > 0 && meshView.objectStarts[i] < meshView.objectStarts[i - 1]) return;
+        }
+
+        if (found[BLOCK_TEXTURE]->count != header->textureWidth * header->textureHeight) return;
+        textureView = Image(header->textureWidth, header->textureHeight, (uint32_t*) (base + found[BLOCK_TEXTURE]->offset));
+
+        valid = true;
+    }
+
+    bool isValid() const
+    {
+        return valid;
+    }
+
+    const MeshView& mesh() const
+    {
+        return meshView;
+    }
+
+    const Image& texture() const
+    {
+        return textureView;
+    }
+};
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <cmath>
+#include <random>
+#include <string>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+#include "PixelUtil.h"
+#include "SceneGraph.h"
+
+/**
+ * Procedurally generated meshes for benchmarking the renderers on scenes
+ * with a known shape and size. A generator given the same arguments always
+ * builds the same mesh, on any platform, so timings of different builds are
+ * comparable.
+ */
+
+/**
+ * @param random The generator to draw from.
+ * @return A uniformly distributed number in [0, 1).
+ */
+float randomUnit(std::mt19937& random)
+{
+    // std::mt19937 is fully specified by the standard, but its distributions are not.
+    return (random() >> 8) * (1.0f / 16777216.0f);
+}
+
+/**
+ * Adds a material of a random bright colour.
+ *
+ * @param mesh The mesh to add it to.
+ * @param random The generator to draw the colour from.
+ * @return The index of the material.
+ */
+int addRandomMaterial(Mesh& mesh, std::mt19937& random)
+{
+    int r = 64 + (int) (randomUnit(random) * 192);
+    int g = 64 + (int) (randomUnit(random) * 192);
+    int b = 64 + (int) (randomUnit(random) * 192);
+    return mesh.materials.add("random" + std::to_string(mesh.materials.size()), packRGB(r, g, b));
+}
+
+/**
+ * Appends a triangle made of three new vertices.
+ */
+void addTriangle(Mesh& mesh, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, uint32_t material)
+{
+    uint32_t first = mesh.positions.size();
+    mesh.positions.push_back(a);
+    mesh.positions.push_back(b);
+    mesh.positions.push_back(c);
+    mesh.indices.push_back(first);
+    mesh.indices.push_back(first + 1);
+    mesh.indices.push_back(first + 2);
+    mesh.materialIds.push_back(material);
+}
+
+/**
+ * Builds a soup of unconnected triangles of random size, orientation and
+ * colour scattered through a cube, the 3D counterpart of drawRandomTriangle.
+ *
+ * @param triangles The number of triangles.
+ * @param extent Half the width of the cube, which is centred on the origin.
+ * @param size The longest a triangle's corner may be from its centre.
+ * @param seed Picks the scene; the same seed always gives the same triangles.
+ * @return The mesh.
+ */
+Mesh generateTriangleSoup(int triangles, float extent, float size, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    Mesh mesh;
+    for (int m = 0; m < 16; ++m) addRandomMaterial(mesh, random);
+
+    for (int i = 0; i < triangles; ++i)
+    {
+        glm::vec3 centre(randomUnit(random), randomUnit(random), randomUnit(random));
+        centre = (centre * 2.0f - 1.0f) * extent;
+        glm::vec3 corners[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            glm::vec3 offset(randomUnit(random), randomUnit(random), randomUnit(random));
+            corners[k] = centre + (offset * 2.0f - 1.0f) * size;
+        }
+        addTriangle(mesh, corners[0], corners[1], corners[2], random() % 16);
+    }
+    return mesh;
+}
+
+/**
+ * Builds a stack of square layers facing along z, one behind the other, so
+ * every pixel they cover is covered as many times as there are layers.
+ *
+ * @param layers The number of layers.
+ * @param extent Half the width of each layer, which is centred on the z axis.
+ * @param spacing The distance between neighbouring layers. The front layer is at z = 0.
+ * @return The mesh.
+ */
+Mesh generateOverdrawStack(int layers, float extent, float spacing)
+{
+    std::mt19937 random(layers);
+    Mesh mesh;
+    for (int i = 0; i < layers; ++i)
+    {
+        float z = -i * spacing;
+        uint32_t material = addRandomMaterial(mesh, random);
+        glm::vec3 a(-extent, -extent, z), b(extent, -extent, z), c(extent, extent, z), d(-extent, extent, z);
+        addTriangle(mesh, a, b, c, material);
+        addTriangle(mesh, a, c, d, material);
+    }
+    return mesh;
+}
+
+/**
+ * Builds a flat, textured grid in the y = 0 plane. The texture repeats
+ * across the grid, so it is sampled at many levels of detail at once.
+ *
+ * @param cells The number of cells along each side. Each cell is two triangles.
+ * @param extent Half the width of the grid, which is centred on the origin.
+ * @param repeats How many times the texture repeats along each side.
+ * @param texturePath The file the texture is loaded from, as a material library would name it.
+ * @return The mesh.
+ */
+Mesh generateTexturedGrid(int cells, float extent, float repeats, const std::string& texturePath)
+{
+    Mesh mesh;
+    int material = mesh.materials.add("grid", packRGB(255, 255, 255));
+    mesh.materials.setTexture(material, texturePath);
+
+    for (int j = 0; j <= cells; ++j)
+    {
+        for (int i = 0; i <= cells; ++i)
+        {
+            float s = (float) i / cells, t = (float) j / cells;
+            mesh.positions.push_back(glm::vec3((s * 2.0f - 1.0f) * extent, 0.0f, (t * 2.0f - 1.0f) * extent));
+            mesh.texCoords.push_back(s * repeats, t * repeats);
+        }
+    }
+
+    // Vertices and texture coordinates share their numbering.
+    for (int j = 0; j < cells; ++j)
+    {
+        for (int i = 0; i < cells; ++i)
+        {
+            uint32_t a = j * (cells + 1) + i, b = a + 1, c = a + cells + 1, d = c + 1;
+            uint32_t corners[6] = {a, c, b, b, c, d};
+            for (int k = 0; k < 6; ++k)
+            {
+                mesh.indices.push_back(corners[k]);
+                mesh.texCoordIndices.push_back(corners[k]);
+            }
+            mesh.materialIds.push_back(material);
+            mesh.materialIds.push_back(material);
+        }
+    }
+    return mesh;
+}
+
+/**
+ * Builds a finely tessellated sphere out of shared vertices, banded in
+ * colour by latitude.
+ *
+ * @param rings The number of bands from pole to pole.
+ * @param segments The number of slices around the equator. The sphere has 2 * rings * segments triangles.
+ * @param radius The radius of the sphere, which is centred on the origin.
+ * @return The mesh.
+ */
+Mesh generateSphere(int rings, int segments, float radius)
+{
+    std::mt19937 random(rings * segments);
+    Mesh mesh;
+    const int bands = 8;
+    for (int m = 0; m < bands; ++m) addRandomMaterial(mesh, random);
+
+    for (int j = 0; j <= rings; ++j)
+    {
+        float latitude = (float) M_PI * j / rings;
+        for (int i = 0; i <= segments; ++i)
+        {
+            float longitude = 2.0f * (float) M_PI * i / segments;
+            mesh.positions.push_back(radius * glm::vec3(std::sin(latitude) * std::sin(longitude), std::cos(latitude), std::sin(latitude) * std::cos(longitude)));
+        }
+    }
+
+    for (int j = 0; j < rings; ++j)
+    {
+        uint32_t material = j * bands / rings;
+        for (int i = 0; i < segments; ++i)
+        {
+            uint32_t a = j * (segments + 1) + i, b = a + 1, c = a + segments + 1, d = c + 1;
+            uint32_t corners[6] = {a, c, b, b, c, d};
+            for (int k = 0; k < 6; ++k) mesh.indices.push_back(corners[k]);
+            mesh.materialIds.push_back(material);
+            mesh.materialIds.push_back(material);
+        }
+    }
+    return mesh;
+}
+
+/**
+ * Lays out copies of one mesh on a square grid in the y = 0 plane, each
+ * turned to a different angle about y. Every row is a node of its own
+ * under a single root, so moving the root or a row moves all its copies.
+ *
+ * @param graph The graph the nodes are added to.
+ * @param mesh The id of the mesh in the graph.
+ * @param side The number of copies along each side of the grid.
+ * @param spacing The distance between neighbouring copies. The grid is centred on the origin.
+ * @return The root node of the grid.
+ */
+int addInstanceGrid(SceneGraph& graph, int mesh, int side, float spacing)
+{
+    int root = graph.addNode(NO_NODE, Transform());
+    float start = -0.5f * spacing * (side - 1);
+    for (int j = 0; j < side; ++j)
+    {
+        int row = graph.addNode(root, Transform(glm::vec3(0.0f, 0.0f, start + spacing * j)));
+        for (int i = 0; i < side; ++i)
+        {
+            float angle = 2.0f * (float) M_PI * (i + j * side) / (side * side);
+            graph.addNode(row, Transform(glm::vec3(start + spacing * i, 0.0f, 0.0f), glm::vec3(0.0f, angle, 0.0f)), mesh);
+        }
+    }
+    return root;
+}
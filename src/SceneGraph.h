@@ -0,0 +1,300 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <inttypes.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Bounds.h"
+#include "DrawOrder.h"
+#include "Mesh.h"
+
+// Marks a node without a parent, or without a mesh.
+#define NO_NODE -1
+#define NO_MESH -1
+
+/**
+ * A position, rotation and scale relative to a parent node. Points are
+ * scaled, then rotated about x, y and z in that order, then moved.
+ */
+struct Transform
+{
+    glm::vec3 position;
+
+    // Angles about each axis, in radians.
+    glm::vec3 rotation;
+
+    // An odd number of negative scales mirrors the mesh; see SceneGraph::isMirrored.
+    glm::vec3 scale;
+
+    Transform()
+    : position(0.0f)
+    , rotation(0.0f)
+    , scale(1.0f)
+    {}
+
+    Transform(const glm::vec3& position, const glm::vec3& rotation = glm::vec3(0.0f), const glm::vec3& scale = glm::vec3(1.0f))
+    : position(position)
+    , rotation(rotation)
+    , scale(scale)
+    {}
+
+    /**
+     * @return The 4x4 affine matrix that maps points from the node's space to its parent's.
+     */
+    glm::mat4x4 matrix() const
+    {
+        float cx = std::cos(rotation.x), sx = std::sin(rotation.x);
+        float cy = std::cos(rotation.y), sy = std::sin(rotation.y);
+        float cz = std::cos(rotation.z), sz = std::sin(rotation.z);
+
+        // The columns of Rz * Ry * Rx, each scaled by its axis.
+        glm::mat4x4 m(1.0f);
+        m[0] = glm::vec4(cz * cy, sz * cy, -sy, 0.0f) * scale.x;
+        m[1] = glm::vec4(cz * sy * sx - sz * cx, sz * sy * sx + cz * cx, cy * sx, 0.0f) * scale.y;
+        m[2] = glm::vec4(cz * sy * cx + sz * sx, sz * sy * cx - cz * sx, cy * cx, 0.0f) * scale.z;
+        m[3] = glm::vec4(position.x, position.y, position.z, 1.0f);
+        return m;
+    }
+};
+
+/**
+ * A hierarchy of transforms, some of which draw a mesh.
+ *
+ * Each node has a transform relative to its parent and caches its world
+ * matrix, and the world bounds of its mesh if it has one. Changing a
+ * node's transform only marks it dirty; update() then recomputes that node
+ * and everything below it, and nothing else. A scene where nothing moved
+ * costs nothing to update.
+ *
+ * Meshes are shared: any number of nodes may draw the same mesh, each at
+ * its own transform, without copying its vertices or triangles. Meshes are
+ * held as views, so they may live in a Mesh or a mapped scene cache, which
+ * must outlive the graph.
+ *
+ * Nodes are stored flat, every parent before its children, so updates are
+ * a single pass in index order.
+ */
+class SceneGraph
+{
+private:
+    std::vector<MeshView> meshes;
+    std::vector<AABB> meshBounds;
+
+    std::vector<int> parents;
+    std::vector<int> meshIds;
+    std::vector<Transform> locals;
+    std::vector<glm::mat4x4> worlds;
+    std::vector<AABB> worldBounds;
+    std::vector<uint8_t> dirty;
+    bool anyDirty;
+
+    // The nodes that draw a mesh, in the order they were added.
+    std::vector<uint32_t> instances;
+    int largestMesh;
+    int instancedTriangles;
+
+public:
+    SceneGraph()
+    : anyDirty(false)
+    , largestMesh(0)
+    , instancedTriangles(0)
+    {}
+
+    /**
+     * Adds a mesh that nodes can draw.
+     *
+     * @param mesh A view of the mesh, whose arrays must outlive the graph.
+     * @return The mesh's id.
+     */
+    int addMesh(const MeshView& mesh)
+    {
+        AABB bounds;
+        for (int i = 0; i < mesh.vertexCount; ++i) bounds.grow(glm::vec3(mesh.x[i], mesh.y[i], mesh.z[i]));
+        meshes.push_back(mesh);
+        meshBounds.push_back(bounds);
+        largestMesh = std::max(largestMesh, mesh.vertexCount);
+        return meshes.size() - 1;
+    }
+
+    /**
+     * Adds a node below an existing one.
+     *
+     * @param parent The parent node, or NO_NODE for a node at the top of the hierarchy.
+     * @param local The node's transform relative to its parent.
+     * @param mesh The mesh the node draws, or NO_MESH for a node that only groups others.
+     * @return The node's index, which is greater than its parent's.
+     */
+    int addNode(int parent, const Transform& local, int mesh = NO_MESH)
+    {
+        int node = parents.size();
+        parents.push_back(parent);
+        meshIds.push_back(mesh);
+        locals.push_back(local);
+        worlds.push_back(glm::mat4x4(1.0f));
+        worldBounds.push_back(AABB());
+        dirty.push_back(1);
+        anyDirty = true;
+
+        if (mesh != NO_MESH)
+        {
+            instances.push_back(node);
+            instancedTriangles += meshes[mesh].triangleCount;
+        }
+        return node;
+    }
+
+    /**
+     * Moves a node, and with it everything below it, from the next update.
+     *
+     * @param node The node.
+     * @param local The node's new transform relative to its parent.
+     */
+    void setTransform(int node, const Transform& local)
+    {
+        locals[node] = local;
+        dirty[node] = 1;
+        anyDirty = true;
+    }
+
+    const Transform& transform(int node) const
+    {
+        return locals[node];
+    }
+
+    /**
+     * @return True if a transform has changed since the last update, so the world matrices are out of date.
+     */
+    bool isDirty() const
+    {
+        return anyDirty;
+    }
+
+    /**
+     * Recomputes the world matrices and bounds of the nodes that moved and of everything below them.
+     *
+     * @return The number of nodes recomputed.
+     */
+    int update()
+    {
+        if (!anyDirty) return 0;
+
+        // Parents come first, so a parent's flag is final by the time its children look at it.
+        int updated = 0;
+        for (size_t node = 0; node < parents.size(); ++node)
+        {
+            int parent = parents[node];
+            if (parent != NO_NODE && dirty[parent]) dirty[node] = 1;
+            if (!dirty[node]) continue;
+
+            worlds[node] = parent != NO_NODE ? worlds[parent] * locals[node].matrix() : locals[node].matrix();
+            if (meshIds[node] != NO_MESH) worldBounds[node] = transformBox(meshBounds[meshIds[node]], worlds[node]);
+            ++updated;
+        }
+
+        std::fill(dirty.begin(), dirty.end(), 0);
+        anyDirty = false;
+        return updated;
+    }
+
+    /**
+     * @param node The node.
+     * @return The 4x4 affine matrix that maps points from the node's space to the world space, as of the last update.
+     */
+    const glm::mat4x4& world(int node) const
+    {
+        return worlds[node];
+    }
+
+    /**
+     * @param node The node.
+     * @return True if the node's world matrix, as of the last update, mirrors it, so its triangles wind the other way on screen.
+     */
+    bool isMirrored(int node) const
+    {
+        const glm::mat4x4& m = worlds[node];
+        return glm::dot(glm::cross(glm::vec3(m[0]), glm::vec3(m[1])), glm::vec3(m[2])) < 0.0f;
+    }
+
+    /**
+     * @param node The node.
+     * @return The world bounds of the node's mesh as of the last update, or an empty box if it has none.
+     */
+    const AABB& bounds(int node) const
+    {
+        return worldBounds[node];
+    }
+
+    /**
+     * @param node The node.
+     * @return The mesh the node draws, or NO_MESH.
+     */
+    int meshOf(int node) const
+    {
+        return meshIds[node];
+    }
+
+    const MeshView& mesh(int id) const
+    {
+        return meshes[id];
+    }
+
+    int nodeCount() const
+    {
+        return parents.size();
+    }
+
+    int instanceCount() const
+    {
+        return instances.size();
+    }
+
+    /**
+     * @return The most vertices any one mesh has, so one buffer can hold any instance's projected vertices.
+     */
+    int largestMeshVertices() const
+    {
+        return largestMesh;
+    }
+
+    /**
+     * @return The triangles drawn if every instance is visible, counting each instance's mesh once per instance.
+     */
+    int triangleCount() const
+    {
+        return instancedTriangles;
+    }
+
+    /**
+     * Lists the instances inside a frustum nearest first, like sortFrontToBack
+     * does for the leaves of a BVH. The graph must be up to date.
+     *
+     * @param frustum The frustum, in world space.
+     * @param worldToCamera A 4x4 affine matrix that maps points from the world space to the camera space.
+     * @param items Receives an item per visible instance, holding its node. Its storage is reused.
+     * @param scratch Storage for the sort. It is reused between calls.
+     */
+    void sortVisibleInstances(const Frustum& frustum, const glm::mat4x4& worldToCamera,
+                              std::vector<DrawItem>& items, std::vector<DrawItem>& scratch) const
+    {
+        items.clear();
+
+        // The camera looks down -z, so depth is minus the camera space z row.
+        glm::vec3 axis(-worldToCamera[0][2], -worldToCamera[1][2], -worldToCamera[2][2]);
+        glm::vec3 reach(std::abs(axis.x), std::abs(axis.y), std::abs(axis.z));
+        float offset = -worldToCamera[3][2];
+
+        for (uint32_t node : instances)
+        {
+            const AABB& box = worldBounds[node];
+            if (box.isEmpty() || cullBox(frustum, box, FRUSTUM_ALL_PLANES) < 0) continue;
+
+            DrawItem item;
+            item.key = depthKey(glm::dot(axis, box.centre()) + offset - glm::dot(reach, box.extent() * 0.5f));
+            item.node = node;
+            items.push_back(item);
+        }
+
+        radixSort(items, scratch);
+    }
+};
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <inttypes.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Wider kernels are compiled for their own instruction sets and picked
+// when the program starts, so one binary runs on any x86 processor.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SPAN_DISPATCH 1
+#endif
+
+/**
+ * What a fill does with the depth buffer.
+ */
+enum DepthMode
+{
+  // Draws pixels nearer than the depth buffer and writes their depth.
+  DEPTH_NEARER,
+
+  // Writes the depth of nearer pixels without drawing them.
+  DEPTH_ONLY,
+
+  // Draws only pixels at exactly the depth a DEPTH_ONLY pass left, so each
+  // is drawn once. Where triangles tie exactly, the last one drawn wins.
+  DEPTH_EQUAL
+};
+
+/**
+ * Depth tests a run of pixels in a row and fills those that pass with a flat colour.
+ *
+ * Every kernel evaluates a pixel's depth as zRow + dz * x, as the scalar
+ * rasterizer does, so they all leave identical depth and colour. Columns
+ * are exact in float, far past any frame width.
+ *
+ * @param depth The row of the depth buffer.
+ * @param pixels The row of the colour buffer.
+ * @param x The first column of the run.
+ * @param count The number of pixels in the run.
+ * @param zRow The depth plane at column 0 of the row.
+ * @param dz The depth plane's step per column.
+ * @param colour A bitpacked ARGB colour.
+ * @param mode What the fill does with the depth buffer.
+ * @return The number of pixels that passed the depth test.
+ */
+typedef int (*FillSpan)(float* depth, uint32_t* pixels, int x, int count, float zRow, float dz, uint32_t colour, DepthMode mode);
+
+/**
+ * Depth tests a run of pixels in a row, writing depth as the mode does, and
+ * lists the columns that pass so they can be shaded.
+ *
+ * @param depth The row of the depth buffer.
+ * @param x The first column of the run.
+ * @param count The number of pixels in the run.
+ * @param zRow The depth plane at column 0 of the row.
+ * @param dz The depth plane's step per column.
+ * @param mode DEPTH_NEARER or DEPTH_EQUAL.
+ * @param passed Receives the columns that pass, in order. Room for count is needed.
+ * @return The number of columns in passed.
+ */
+typedef int (*TestSpan)(float* depth, int x, int count, float zRow, float dz, DepthMode mode, int* passed);
+
+int fillSpanScalar(float* depth, uint32_t* pixels, int x, int count, float zRow, float dz, uint32_t colour, DepthMode mode)
+{
+  int n = 0;
+  for (int end = x + count; x < end; ++x)
+  {
+    float value = zRow + dz * x;
+    if (mode == DEPTH_EQUAL ? value != depth[x] : !(value > depth[x])) continue;
+    if (mode != DEPTH_EQUAL) depth[x] = value;
+    if (mode != DEPTH_ONLY) pixels[x] = colour;
+    ++n;
+  }
+  return n;
+}
+
+int testSpanScalar(float* depth, int x, int count, float zRow, float dz, DepthMode mode, int* passed)
+{
+  int n = 0;
+  for (int end = x + count; x < end; ++x)
+  {
+    float value = zRow + dz * x;
+    if (mode == DEPTH_EQUAL ? value == depth[x] : value > depth[x])
+    {
+      if (mode != DEPTH_EQUAL) depth[x] = value;
+      passed[n++] = x;
+    }
+  }
+  return n;
+}
+
+#if defined(__SSE2__)
+
+int fillSpanSSE2(float* depth, uint32_t* pixels, int x, int count, float zRow, float dz, uint32_t colour, DepthMode mode)
+{
+  const __m128 lanes = _mm_set_ps(3, 2, 1, 0);
+  const __m128 row = _mm_set1_ps(zRow), step = _mm_set1_ps(dz);
+  const __m128i fill = _mm_set1_epi32((int) colour);
+  int end = x + count;
+  int n = 0;
+
+  // SSE2 has no masked stores, so passing lanes are blended into what was there.
+  for (; x + 4 <= end; x += 4)
+  {
+    __m128 value = _mm_add_ps(row, _mm_mul_ps(step, _mm_add_ps(_mm_set1_ps((float) x), lanes)));
+    __m128 stored = _mm_loadu_ps(depth + x);
+    __m128 pass = mode == DEPTH_EQUAL ? _mm_cmpeq_ps(value, stored) : _mm_cmpgt_ps(value, stored);
+    int bits = _mm_movemask_ps(pass);
+    if (bits == 0) continue;
+    n += __builtin_popcount(bits);
+
+    if (mode != DEPTH_EQUAL) _mm_storeu_ps(depth + x, _mm_or_ps(_mm_and_ps(pass, value), _mm_andnot_ps(pass, stored)));
+    if (mode != DEPTH_ONLY)
+    {
+      __m128i mask = _mm_castps_si128(pass);
+      __m128i old = _mm_loadu_si128((const __m128i*) (pixels + x));
+      _mm_storeu_si128((__m128i*) (pixels + x), _mm_or_si128(_mm_and_si128(mask, fill), _mm_andnot_si128(mask, old)));
+    }
+  }
+  return n + fillSpanScalar(depth, pixels, x, end - x, zRow, dz, colour, mode);
+}
+
+int testSpanSSE2(float* depth, int x, int count, float zRow, float dz, DepthMode mode, int* passed)
+{
+  const __m128 lanes = _mm_set_ps(3, 2, 1, 0);
+  const __m128 row = _mm_set1_ps(zRow), step = _mm_set1_ps(dz);
+  int end = x + count;
+  int n = 0;
+
+  for (; x + 4 <= end; x += 4)
+  {
+    __m128 value = _mm_add_ps(row, _mm_mul_ps(step, _mm_add_ps(_mm_set1_ps((float) x), lanes)));
+    __m128 stored = _mm_loadu_ps(depth + x);
+    __m128 pass = mode == DEPTH_EQUAL ? _mm_cmpeq_ps(value, stored) : _mm_cmpgt_ps(value, stored);
+    int bits = _mm_movemask_ps(pass);
+    if (bits == 0) continue;
+
+    if (mode != DEPTH_EQUAL) _mm_storeu_ps(depth + x, _mm_or_ps(_mm_and_ps(pass, value), _mm_andnot_ps(pass, stored)));
+    for (; bits != 0; bits &= bits - 1) passed[n++] = x + __builtin_ctz(bits);
+  }
+  return n + testSpanScalar(depth, x, end - x, zRow, dz, mode, passed + n);
+}
+
+#endif
+
+#if defined(SPAN_DISPATCH)
+
+__attribute__((target("avx2")))
+int fillSpanAVX2(float* depth, uint32_t* pixels, int x, int count, float zRow, float dz, uint32_t colour, DepthMode mode)
+{
+  const __m256 lanes = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+  const __m256 row = _mm256_set1_ps(zRow), step = _mm256_set1_ps(dz);
+  const __m256i fill = _mm256_set1_epi32((int) colour);
+  int end = x + count;
+  int n = 0;
+
+  for (; x + 8 <= end; x += 8)
+  {
+    __m256 value = _mm256_add_ps(row, _mm256_mul_ps(step, _mm256_add_ps(_mm256_set1_ps((float) x), lanes)));
+    __m256 stored = _mm256_loadu_ps(depth + x);
+    __m256 pass = mode == DEPTH_EQUAL ? _mm256_cmp_ps(value, stored, _CMP_EQ_OQ) : _mm256_cmp_ps(value, stored, _CMP_GT_OQ);
+    int bits = _mm256_movemask_ps(pass);
+    if (bits == 0) continue;
+    n += __builtin_popcount(bits);
+
+    __m256i mask = _mm256_castps_si256(pass);
+    if (mode != DEPTH_EQUAL) _mm256_maskstore_ps(depth + x, mask, value);
+    if (mode != DEPTH_ONLY) _mm256_maskstore_epi32((int*) (pixels + x), mask, fill);
+  }
+  return n + fillSpanScalar(depth, pixels, x, end - x, zRow, dz, colour, mode);
+}
+
+__attribute__((target("avx2")))
+int testSpanAVX2(float* depth, int x, int count, float zRow, float dz, DepthMode mode, int* passed)
+{
+  const __m256 lanes = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+  const __m256 row = _mm256_set1_ps(zRow), step = _mm256_set1_ps(dz);
+  int end = x + count;
+  int n = 0;
+
+  for (; x + 8 <= end; x += 8)
+  {
+    __m256 value = _mm256_add_ps(row, _mm256_mul_ps(step, _mm256_add_ps(_mm256_set1_ps((float) x), lanes)));
+    __m256 stored = _mm256_loadu_ps(depth + x);
+    __m256 pass = mode == DEPTH_EQUAL ? _mm256_cmp_ps(value, stored, _CMP_EQ_OQ) : _mm256_cmp_ps(value, stored, _CMP_GT_OQ);
+    int bits = _mm256_movemask_ps(pass);
+    if (bits == 0) continue;
+
+    if (mode != DEPTH_EQUAL) _mm256_maskstore_ps(depth + x, _mm256_castps_si256(pass), value);
+    for (; bits != 0; bits &= bits - 1) passed[n++] = x + __builtin_ctz(bits);
+  }
+  return n + testSpanScalar(depth, x, end - x, zRow, dz, mode, passed + n);
+}
+
+// AVX-512 brings FMA with it, and a fused multiply-add rounds once where
+// the other kernels round twice. Multiplying with explicit rounding keeps
+// the product separate so the depth matches to the last bit, unless the
+// whole build allows fusing (-march=native on an FMA machine), in which
+// case each kernel still agrees with itself. The multiply is masked with
+// every lane set: GCC's unmasked form warns of an uninitialised register
+// when optimising, and a literal 0xFFFF mask overflows its short at -O0.
+#define SPAN_ROUNDING (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+
+// Masks cover the tail of a run too, so no scalar loop is needed.
+__attribute__((target("avx512f")))
+int fillSpanAVX512(float* depth, uint32_t* pixels, int x, int count, float zRow, float dz, uint32_t colour, DepthMode mode)
+{
+  const __m512 lanes = _mm512_set_ps(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  const __m512 row = _mm512_set1_ps(zRow), step = _mm512_set1_ps(dz);
+  const __m512i fill = _mm512_set1_epi32((int) colour);
+  int end = x + count;
+  int n = 0;
+
+  for (; x < end; x += 16)
+  {
+    __mmask16 inside = end - x >= 16 ? (__mmask16) 0xFFFF : (__mmask16) ((1u << (end - x)) - 1);
+    __m512 value = _mm512_add_ps(row, _mm512_maskz_mul_round_ps((__mmask16) -1, step, _mm512_add_ps(_mm512_set1_ps((float) x), lanes), SPAN_ROUNDING));
+    __m512 stored = _mm512_maskz_loadu_ps(inside, depth + x);
+    __mmask16 pass = mode == DEPTH_EQUAL ? _mm512_mask_cmp_ps_mask(inside, value, stored, _CMP_EQ_OQ)
+                                         : _mm512_mask_cmp_ps_mask(inside, value, stored, _CMP_GT_OQ);
+    if (mode != DEPTH_EQUAL) _mm512_mask_storeu_ps(depth + x, pass, value);
+    if (mode != DEPTH_ONLY) _mm512_mask_storeu_epi32(pixels + x, pass, fill);
+    n += __builtin_popcount(pass);
+  }
+  return n;
+}
+
+__attribute__((target("avx512f")))
+int testSpanAVX512(float* depth, int x, int count, float zRow, float dz, DepthMode mode, int* passed)
+{
+  const __m512i lanes = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  const __m512 laneOffsets = _mm512_set_ps(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  const __m512 row = _mm512_set1_ps(zRow), step = _mm512_set1_ps(dz);
+  int end = x + count;
+  int n = 0;
+
+  for (; x < end; x += 16)
+  {
+    __mmask16 inside = end - x >= 16 ? (__mmask16) 0xFFFF : (__mmask16) ((1u << (end - x)) - 1);
+    __m512i columns = _mm512_add_epi32(_mm512_set1_epi32(x), lanes);
+    __m512 value = _mm512_add_ps(row, _mm512_maskz_mul_round_ps((__mmask16) -1, step, _mm512_add_ps(_mm512_set1_ps((float) x), laneOffsets), SPAN_ROUNDING));
+    __m512 stored = _mm512_maskz_loadu_ps(inside, depth + x);
+    __mmask16 pass = mode == DEPTH_EQUAL ? _mm512_mask_cmp_ps_mask(inside, value, stored, _CMP_EQ_OQ)
+                                         : _mm512_mask_cmp_ps_mask(inside, value, stored, _CMP_GT_OQ);
+    if (mode != DEPTH_EQUAL) _mm512_mask_storeu_ps(depth + x, pass, value);
+    _mm512_mask_compressstoreu_epi32(passed + n, pass, columns);
+    n += __builtin_popcount(pass);
+  }
+  return n;
+}
+
+#endif
+
+/**
+ * The span kernels for the processor the program is running on.
+ */
+struct SpanKernels
+{
+  FillSpan fill;
+  TestSpan test;
+  const char* name;
+};
+
+SpanKernels chooseSpanKernels()
+{
+#if defined(SPAN_DISPATCH)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+  {
+    SpanKernels kernels = {fillSpanAVX512, testSpanAVX512, "AVX-512"};
+    return kernels;
+  }
+  if (__builtin_cpu_supports("avx2"))
+  {
+    SpanKernels kernels = {fillSpanAVX2, testSpanAVX2, "AVX2"};
+    return kernels;
+  }
+#endif
+
+#if defined(__SSE2__)
+  SpanKernels kernels = {fillSpanSSE2, testSpanSSE2, "SSE2"};
+#else
+  SpanKernels kernels = {fillSpanScalar, testSpanScalar, "scalar"};
+#endif
+  return kernels;
+}
+
+/**
+ * The span kernels in use, chosen the first time they are asked for.
+ */
+inline const SpanKernels& spanKernels()
+{
+  static const SpanKernels kernels = chooseSpanKernels();
+  return kernels;
+}
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <inttypes.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "Image.h"
+
+// Texels are stored in square blocks of this many texels a side.
+#define TEXTURE_BLOCK_BITS 2
+#define TEXTURE_BLOCK_SIZE (1 << TEXTURE_BLOCK_BITS)
+
+/**
+ * How texture coordinates outside 0 to 1 are resolved.
+ */
+enum TextureAddress
+{
+  TEXTURE_CLAMP,
+  TEXTURE_WRAP
+};
+
+/**
+ * How texels are combined into a sample.
+ */
+enum TextureFilter
+{
+  TEXTURE_POINT,
+  TEXTURE_BILINEAR,
+  TEXTURE_TRILINEAR
+};
+
+/**
+ * Resolves a texel index along one axis of a texture.
+ */
+inline int addressTexel(int i, int size, TextureAddress address)
+{
+  if (address == TEXTURE_WRAP)
+  {
+    i %= size;
+    return i < 0 ? i + size : i;
+  }
+  return i < 0 ? 0 : (i >= size ? size - 1 : i);
+}
+
+/**
+ * Blends two packed ARGB colours, two channels per multiply.
+ *
+ * @param a The colour at weight 0.
+ * @param b The colour at weight 256.
+ * @param weight How far towards b, from 0 to 256.
+ */
+inline uint32_t lerpColour(uint32_t a, uint32_t b, uint32_t weight)
+{
+  uint32_t aRB = a & 0x00FF00FF, aAG = (a >> 8) & 0x00FF00FF;
+  uint32_t bRB = b & 0x00FF00FF, bAG = (b >> 8) & 0x00FF00FF;
+  uint32_t rb = (aRB * (256 - weight) + bRB * weight) >> 8;
+  uint32_t ag = (aAG * (256 - weight) + bAG * weight) >> 8;
+  return (rb & 0x00FF00FF) | ((ag & 0x00FF00FF) << 8);
+}
+
+/**
+ * An image prepared for sampling: a full mip chain, each level stored in
+ * 4x4 texel blocks so the texels a filter footprint touches share a cache
+ * line, whichever direction a triangle walks across the texture.
+ *
+ * Texture coordinates run from 0 to 1 across the image, with v = 0 at the top.
+ * Level of detail is log2 of texels per pixel; 0 is the full resolution image.
+ */
+class Texture
+{
+private:
+  struct Level
+  {
+    int width, height;
+    int blocksX;
+    size_t offset;
+  };
+
+  std::vector<Level> levels;
+  std::vector<uint32_t> texels;
+
+  void addLevel(const std::vector<uint32_t>& linear, int width, int height)
+  {
+    Level level;
+    level.width = width;
+    level.height = height;
+    level.blocksX = (width + TEXTURE_BLOCK_SIZE - 1) >> TEXTURE_BLOCK_BITS;
+    level.offset = texels.size();
+    int blocksY = (height + TEXTURE_BLOCK_SIZE - 1) >> TEXTURE_BLOCK_BITS;
+    texels.resize(texels.size() + (size_t) level.blocksX * blocksY * TEXTURE_BLOCK_SIZE * TEXTURE_BLOCK_SIZE);
+    levels.push_back(level);
+
+    // Blocks past the edge of the image repeat its last row and column.
+    for (int y = 0; y < blocksY * TEXTURE_BLOCK_SIZE; ++y)
+    {
+      for (int x = 0; x < level.blocksX * TEXTURE_BLOCK_SIZE; ++x)
+      {
+        texels[texelIndex(level, x, y)] = linear[std::min(y, height - 1) * width + std::min(x, width - 1)];
+      }
+    }
+  }
+
+  static size_t texelIndex(const Level& level, int x, int y)
+  {
+    size_t block = (size_t) (y >> TEXTURE_BLOCK_BITS) * level.blocksX + (x >> TEXTURE_BLOCK_BITS);
+    return level.offset + (block << (2 * TEXTURE_BLOCK_BITS))
+         + ((y & (TEXTURE_BLOCK_SIZE - 1)) << TEXTURE_BLOCK_BITS) + (x & (TEXTURE_BLOCK_SIZE - 1));
+  }
+
+  uint32_t texel(const Level& level, int x, int y) const
+  {
+    return texels[texelIndex(level, x, y)];
+  }
+
+  uint32_t point(const Level& level, float u, float v, TextureAddress address) const
+  {
+    int x = addressTexel((int) floorf(u * level.width), level.width, address);
+    int y = addressTexel((int) floorf(v * level.height), level.height, address);
+    return texel(level, x, y);
+  }
+
+  uint32_t bilinear(const Level& level, float u, float v, TextureAddress address) const
+  {
+    // Texel centres sit at half integers.
+    float fx = u * level.width - 0.5f;
+    float fy = v * level.height - 0.5f;
+    float floorX = floorf(fx), floorY = floorf(fy);
+    uint32_t weightX = (uint32_t) ((fx - floorX) * 256.0f);
+    uint32_t weightY = (uint32_t) ((fy - floorY) * 256.0f);
+
+    int x0 = addressTexel((int) floorX, level.width, address);
+    int y0 = addressTexel((int) floorY, level.height, address);
+    int x1 = addressTexel((int) floorX + 1, level.width, address);
+    int y1 = addressTexel((int) floorY + 1, level.height, address);
+
+    uint32_t top = lerpColour(texel(level, x0, y0), texel(level, x1, y0), weightX);
+    uint32_t bottom = lerpColour(texel(level, x0, y1), texel(level, x1, y1), weightX);
+    return lerpColour(top, bottom, weightY);
+  }
+
+public:
+  Texture() {}
+
+  /**
+   * Builds the mip chain of an image. Each level is a 2x2 box filter of the one above.
+   *
+   * @param image A loaded image.
+   */
+  explicit Texture(const Image& image)
+  {
+    int width = image.getWidth();
+    int height = image.getHeight();
+    if (width <= 0 || height <= 0) return;
+
+    std::vector<uint32_t> linear(image.getPayload(), image.getPayload() + width * height);
+    addLevel(linear, width, height);
+
+    while (width > 1 || height > 1)
+    {
+      int nextWidth = std::max(width / 2, 1);
+      int nextHeight = std::max(height / 2, 1);
+      std::vector<uint32_t> next(nextWidth * nextHeight);
+
+      for (int y = 0; y < nextHeight; ++y)
+      {
+        int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+        for (int x = 0; x < nextWidth; ++x)
+        {
+          int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+          uint32_t top = lerpColour(linear[y0 * width + x0], linear[y0 * width + x1], 128);
+          uint32_t bottom = lerpColour(linear[y1 * width + x0], linear[y1 * width + x1], 128);
+          next[y * nextWidth + x] = lerpColour(top, bottom, 128);
+        }
+      }
+
+      linear.swap(next);
+      width = nextWidth;
+      height = nextHeight;
+      addLevel(linear, width, height);
+    }
+  }
+
+  bool isEmpty() const
+  {
+    return levels.empty();
+  }
+
+  int getLevelCount() const
+  {
+    return levels.size();
+  }
+
+  int getWidth() const
+  {
+    return levels.empty() ? 0 : levels[0].width;
+  }
+
+  int getHeight() const
+  {
+    return levels.empty() ? 0 : levels[0].height;
+  }
+
+  /**
+   * Samples the texture at one texture coordinate.
+   *
+   * @param u The horizontal coordinate, 0 at the left edge and 1 at the right.
+   * @param v The vertical coordinate, 0 at the top edge and 1 at the bottom.
+   * @param lod The level of detail. Point and bilinear sampling use the nearest level.
+   * @param filter How texels are combined.
+   * @param address How coordinates outside 0 to 1 are treated.
+   * @return A bitpacked ARGB colour.
+   */
+  uint32_t sample(float u, float v, float lod, TextureFilter filter, TextureAddress address) const
+  {
+    uint32_t colour;
+    sampleSpan(&u, &v, 1, lod, filter, address, &colour);
+    return colour;
+  }
+
+  /**
+   * Samples a run of texture coordinates that share a level of detail, such
+   * as a span of pixels. Level selection and filter dispatch happen once per call.
+   *
+   * @param u The horizontal coordinates.
+   * @param v The vertical coordinates.
+   * @param count The number of samples.
+   * @param lod The level of detail of the whole run.
+   * @param filter How texels are combined.
+   * @param address How coordinates outside 0 to 1 are treated.
+   * @param out Receives count bitpacked ARGB colours.
+   */
+  void sampleSpan(const float* u, const float* v, int count, float lod,
+                  TextureFilter filter, TextureAddress address, uint32_t* out) const
+  {
+    int last = levels.size() - 1;
+    lod = std::min(std::max(lod, 0.0f), (float) last);
+
+    if (filter == TEXTURE_TRILINEAR)
+    {
+      int finer = (int) lod;
+      const Level& fine = levels[finer];
+      const Level& coarse = levels[std::min(finer + 1, last)];
+      uint32_t weight = (uint32_t) ((lod - finer) * 256.0f);
+      if (weight > 0)
+      {
+        for (int i = 0; i < count; ++i)
+        {
+          out[i] = lerpColour(bilinear(fine, u[i], v[i], address), bilinear(coarse, u[i], v[i], address), weight);
+        }
+        return;
+      }
+      filter = TEXTURE_BILINEAR;
+    }
+
+    const Level& level = levels[(int) (lod + 0.5f)];
+    if (filter == TEXTURE_BILINEAR)
+    {
+      for (int i = 0; i < count; ++i) out[i] = bilinear(level, u[i], v[i], address);
+    }
+    else
+    {
+      for (int i = 0; i < count; ++i) out[i] = point(level, u[i], v[i], address);
+    }
+  }
+};
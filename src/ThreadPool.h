@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of worker threads that split loops of independent jobs between them.
+ * The calling thread also takes jobs, so a pool of n threads starts n - 1 workers.
+ */
+class ThreadPool
+{
+private:
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+
+  // The loop body being run, called through a function that knows its type, so starting a loop never allocates.
+  const void* job;
+  void (*invoke)(const void* job, int i);
+  std::atomic<int> next;
+  int jobCount;
+  int busy;
+  unsigned generation;
+  bool stopping;
+
+  template <typename Fn>
+  static void call(const void* fn, int i)
+  {
+    (*(const Fn*) fn)(i);
+  }
+
+  void drain()
+  {
+    int i;
+    while ((i = next++) < jobCount) invoke(job, i);
+  }
+
+  void run()
+  {
+    unsigned seen = 0;
+    while (true)
+    {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+      }
+
+      drain();
+
+      std::unique_lock<std::mutex> lock(mutex);
+      if (--busy == 0) done.notify_all();
+    }
+  }
+
+public:
+  /**
+   * @param threads The total number of threads to run jobs on, including the caller.
+   */
+  ThreadPool(int threads = std::thread::hardware_concurrency())
+  : job(NULL)
+  , invoke(NULL)
+  , next(0)
+  , jobCount(0)
+  , busy(0)
+  , generation(0)
+  , stopping(false)
+  {
+    for (int i = 1; i < threads; ++i)
+    {
+      workers.push_back(std::thread(&ThreadPool::run, this));
+    }
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) worker.join();
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int size() const
+  {
+    return workers.size() + 1;
+  }
+
+  /**
+   * Runs fn(i) for every i in [0, count) across the pool and waits for all of them to finish.
+   * Jobs are handed out in order but may complete in any order.
+   *
+   * @param count The number of jobs.
+   * @param fn The job to run.
+   */
+  template <typename Fn>
+  void parallelFor(int count, const Fn& fn)
+  {
+    if (workers.empty())
+    {
+      for (int i = 0; i < count; ++i) fn(i);
+      return;
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      job = &fn;
+      invoke = &call<Fn>;
+      jobCount = count;
+      next = 0;
+      busy = workers.size();
+      ++generation;
+    }
+    wake.notify_all();
+
+    drain();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return busy == 0; });
+  }
+};
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <inttypes.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <CanvasTriangle.h>
+#include "FrameArena.h"
+#include "FrameBuffer.h"
+#include "PixelUtil.h"
+#include "Profiler.h"
+#include "Rasterizer.h"
+#include "ThreadPool.h"
+
+#define TILE_SIZE 64
+
+/**
+ * A projected triangle waiting in the bins to be rasterized.
+ */
+struct BinnedTriangle
+{
+  CanvasPoint vertices[3];
+  uint32_t colour;
+
+  // Textured triangles take their colour from here instead, using each vertex's texturePoint.
+  const Texture* texture;
+  TextureFilter filter;
+  TextureAddress address;
+
+  // The tiles its bounding box overlaps, inclusive.
+  uint16_t tileMinX, tileMinY, tileMaxX, tileMaxY;
+};
+
+/**
+ * Rasterizes a frame in screen space tiles spread across a thread pool.
+ *
+ * Triangles are submitted in draw order and, when the frame is flushed,
+ * sorted into every tile their bounding box touches. The bins are built
+ * in the frame arena, so binning allocates nothing once it is warm. Each
+ * tile is then cleared and filled by a single thread, which is the only
+ * thread that touches that tile's colour and depth memory. Triangles reach a tile in submission order and the rasterizer is
+ * exact, so the output is identical to drawing everything on one thread.
+ */
+class TiledRenderer
+{
+private:
+  ThreadPool& pool;
+  FrameArena& arena;
+  int width, height;
+  int tilesX, tilesY;
+  std::vector<BinnedTriangle> triangles;
+  bool depthPrePass;
+
+  void bin(BinnedTriangle& triangle)
+  {
+    const CanvasPoint& v0 = triangle.vertices[0];
+    const CanvasPoint& v1 = triangle.vertices[1];
+    const CanvasPoint& v2 = triangle.vertices[2];
+
+    // Matches the rejection in rasterizeTriangle, so these never reach a bin.
+    float minX = std::min(v0.x, std::min(v1.x, v2.x));
+    float minY = std::min(v0.y, std::min(v1.y, v2.y));
+    float maxX = std::max(v0.x, std::max(v1.x, v2.x));
+    float maxY = std::max(v0.y, std::max(v1.y, v2.y));
+    if (v0.depth <= 0 || v1.depth <= 0 || v2.depth <= 0 || !(maxX >= 0 && maxY >= 0 && minX < width && minY < height))
+    {
+      PROFILE_COUNT(COUNT_TRIANGLES_CULLED, 1);
+      return;
+    }
+
+    triangle.tileMinX = (int) std::floor(std::max(minX, 0.0f)) / TILE_SIZE;
+    triangle.tileMinY = (int) std::floor(std::max(minY, 0.0f)) / TILE_SIZE;
+    triangle.tileMaxX = (int) std::floor(std::min(maxX, width - 1.0f)) / TILE_SIZE;
+    triangle.tileMaxY = (int) std::floor(std::min(maxY, height - 1.0f)) / TILE_SIZE;
+    triangles.push_back(triangle);
+  }
+
+  /**
+   * Counting sorts the submitted triangles by tile, keeping submission order within each tile.
+   *
+   * @param arena The arena the bins are allocated from.
+   * @param binStart Receives tilesX * tilesY + 1 offsets; tile i's triangles are binned[binStart[i]] to binned[binStart[i + 1] - 1].
+   * @param binned Receives the triangle indices of every bin, one after another.
+   */
+  void sortIntoBins(FrameArena& arena, uint32_t*& binStart, uint32_t*& binned) const
+  {
+    int tileCount = tilesX * tilesY;
+    binStart = arena.allocate<uint32_t>(tileCount + 1);
+    std::fill(binStart, binStart + tileCount + 1, 0u);
+    for (const BinnedTriangle& t : triangles)
+    {
+      for (int ty = t.tileMinY; ty <= t.tileMaxY; ++ty)
+      {
+        for (int tx = t.tileMinX; tx <= t.tileMaxX; ++tx) ++binStart[tx + tilesX * ty + 1];
+      }
+    }
+    for (int i = 0; i < tileCount; ++i) binStart[i + 1] += binStart[i];
+
+    binned = arena.allocate<uint32_t>(binStart[tileCount]);
+    uint32_t* cursor = arena.allocate<uint32_t>(tileCount);
+    std::copy(binStart, binStart + tileCount, cursor);
+    for (uint32_t index = 0; index < triangles.size(); ++index)
+    {
+      const BinnedTriangle& t = triangles[index];
+      for (int ty = t.tileMinY; ty <= t.tileMaxY; ++ty)
+      {
+        for (int tx = t.tileMinX; tx <= t.tileMaxX; ++tx) binned[cursor[tx + tilesX * ty]++] = index;
+      }
+    }
+  }
+
+  static void rasterize(const BinnedTriangle& t, FrameBuffer& frame, int x0, int y0, int x1, int y1, DepthMode mode)
+  {
+    if (t.texture != NULL)
+    {
+      rasterizeTexturedTriangle(t.vertices[0], t.vertices[1], t.vertices[2], *t.texture, t.filter, t.address, frame, x0, y0, x1, y1, mode);
+    }
+    else
+    {
+      rasterizeTriangle(t.vertices[0], t.vertices[1], t.vertices[2], t.colour, frame, x0, y0, x1, y1, mode);
+    }
+  }
+
+public:
+  /**
+   * @param pool The threads tiles are drawn on.
+   * @param arena The arena the bins are built in each frame.
+   * @param width The width of the frame buffers to be flushed to.
+   * @param height The height of the frame buffers to be flushed to.
+   */
+  TiledRenderer(ThreadPool& pool, FrameArena& arena, int width, int height)
+  : pool(pool)
+  , arena(arena)
+  , width(width)
+  , height(height)
+  , tilesX((width + TILE_SIZE - 1) / TILE_SIZE)
+  , tilesY((height + TILE_SIZE - 1) / TILE_SIZE)
+  , depthPrePass(false)
+  {}
+
+  /**
+   * Changes the size of the frames drawn, emptying the bins.
+   *
+   * @param newWidth The width of the frame buffers to be flushed to.
+   * @param newHeight The height of the frame buffers to be flushed to.
+   */
+  void resize(int newWidth, int newHeight)
+  {
+    width = newWidth;
+    height = newHeight;
+    tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    begin();
+  }
+
+  /**
+   * Chooses whether each tile's triangles are drawn in two passes: depth
+   * only, then colour for just the pixels that are visible in the end.
+   * Colour is then worked out once per pixel whatever the draw order, at
+   * the cost of rasterizing every triangle twice.
+   *
+   * @param enabled Whether to draw a depth pre-pass.
+   */
+  void setDepthPrePass(bool enabled)
+  {
+    depthPrePass = enabled;
+  }
+
+  bool hasDepthPrePass() const
+  {
+    return depthPrePass;
+  }
+
+  /**
+   * Empties the bins ready for a new frame. The triangles' storage is kept between frames.
+   */
+  void begin()
+  {
+    triangles.clear();
+  }
+
+  /**
+   * Bins a projected triangle into every tile its bounding box overlaps.
+   *
+   * @param v0 The first vertex, in pixels.
+   * @param v1 The second vertex, in pixels.
+   * @param v2 The third vertex, in pixels.
+   * @param colour A bitpacked ARGB colour.
+   */
+  void submit(const CanvasPoint& v0, const CanvasPoint& v1, const CanvasPoint& v2, uint32_t colour)
+  {
+    BinnedTriangle triangle = {{v0, v1, v2}, colour, NULL, TEXTURE_POINT, TEXTURE_CLAMP, 0, 0, 0, 0};
+    bin(triangle);
+  }
+
+  /**
+   * Bins a perspective correct textured triangle.
+   *
+   * @param v0 The first vertex, in pixels. Its texturePoint holds its texture coordinates, from 0 to 1.
+   * @param v1 The second vertex, in pixels.
+   * @param v2 The third vertex, in pixels.
+   * @param texture The texture the triangle is drawn with, which must live until the next flush.
+   * @param filter How texels are combined.
+   * @param address How texture coordinates outside 0 to 1 are treated.
+   */
+  void submit(const CanvasPoint& v0, const CanvasPoint& v1, const CanvasPoint& v2,
+              const Texture& texture, TextureFilter filter, TextureAddress address)
+  {
+    BinnedTriangle triangle = {{v0, v1, v2}, 0, &texture, filter, address, 0, 0, 0, 0};
+    bin(triangle);
+  }
+
+  void submit(const CanvasTriangle& triangle)
+  {
+    uint32_t colour = packRGB(triangle.colour.red, triangle.colour.green, triangle.colour.blue);
+    submit(triangle.vertices[0], triangle.vertices[1], triangle.vertices[2], colour);
+  }
+
+  /**
+   * Clears every tile and rasterizes its binned triangles, in parallel.
+   * The bins live in the frame arena until it is reset.
+   *
+   * @param frame The frame buffer the triangles are to be drawn into.
+   * @param clearColour A bitpacked ARGB colour each tile is cleared to first.
+   */
+  void flush(FrameBuffer& frame, uint32_t clearColour)
+  {
+    PROFILE_SCOPE(STAGE_RASTER);
+    uint32_t* binStart;
+    uint32_t* binned;
+    sortIntoBins(arena, binStart, binned);
+
+    pool.parallelFor(tilesX * tilesY, [&](int tile)
+    {
+      int x0 = (tile % tilesX) * TILE_SIZE;
+      int y0 = (tile / tilesX) * TILE_SIZE;
+      int x1 = std::min(x0 + TILE_SIZE, frame.width) - 1;
+      int y1 = std::min(y0 + TILE_SIZE, frame.height) - 1;
+
+      // Tiles are a whole number of depth blocks, so no two tiles share one.
+      frame.clearTiles(x0, y0, x1, y1, clearColour);
+
+      const uint32_t* first = binned + binStart[tile];
+      const uint32_t* last = binned + binStart[tile + 1];
+      DepthMode mode = DEPTH_NEARER;
+      if (depthPrePass)
+      {
+        for (const uint32_t* index = first; index != last; ++index) rasterize(triangles[*index], frame, x0, y0, x1, y1, DEPTH_ONLY);
+        mode = DEPTH_EQUAL;
+      }
+
+      for (const uint32_t* index = first; index != last; ++index) rasterize(triangles[*index], frame, x0, y0, x1, y1, mode);
+    });
+  }
+};
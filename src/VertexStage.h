@@ -0,0 +1,193 @@
+#pragma once
+
+#include <inttypes.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "FrameArena.h"
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Vertex positions stored as separate x, y and z streams so whole
+ * batches of vertices can be loaded into SIMD registers at once.
+ */
+struct VertexStream
+{
+    std::vector<float> x, y, z;
+
+    int size() const
+    {
+        return x.size();
+    }
+
+    void push_back(const glm::vec3& v)
+    {
+        x.push_back(v.x);
+        y.push_back(v.y);
+        z.push_back(v.z);
+    }
+};
+
+/**
+ * Screen space positions produced by the vertex stage, indexed the same way as the input stream.
+ * Depth is 1/z, as in CanvasPoint.
+ */
+struct ProjectedVertices
+{
+    float* x;
+    float* y;
+    float* depth;
+
+    ProjectedVertices()
+    : x(NULL)
+    , y(NULL)
+    , depth(NULL)
+    {}
+
+    /**
+     * Makes room for a number of vertices, which lasts until the arena is reset.
+     *
+     * @param arena The arena the streams are allocated from.
+     * @param n The number of vertices.
+     */
+    void allocate(FrameArena& arena, int n)
+    {
+        x = arena.allocate<float>(n);
+        y = arena.allocate<float>(n);
+        depth = arena.allocate<float>(n);
+    }
+};
+
+/**
+ * Transforms and projects a range of vertices, one lane at a time.
+ * Used for the tail of a batch that does not fill a SIMD register.
+ */
+inline void transformVerticesScalar(const float* inX, const float* inY, const float* inZ, int begin, int end, const glm::mat4x4& m,
+                                    float scaleX, float scaleY, float offsetX, float offsetY,
+                                    ProjectedVertices& out)
+{
+    for (int i = begin; i < end; ++i)
+    {
+        float x = inX[i], y = inY[i], z = inZ[i];
+        float camX = (m[0][0] * x + m[1][0] * y) + (m[2][0] * z + m[3][0]);
+        float camY = (m[0][1] * x + m[1][1] * y) + (m[2][1] * z + m[3][1]);
+        float camZ = (m[0][2] * x + m[1][2] * y) + (m[2][2] * z + m[3][2]);
+
+        float invZ = 1.0f / -camZ;
+        out.x[i] = offsetX + scaleX * camX * invZ;
+        out.y[i] = offsetY - scaleY * camY * invZ;
+        out.depth[i] = invZ;
+    }
+}
+
+/**
+ * Transforms a range of vertices into camera space and projects them to screen space.
+ * Gives the same result as project2D, with one reciprocal per vertex, and
+ * processes 8 (AVX) or 4 (SSE) vertices per iteration when available.
+ *
+ * @param inX The world space x coordinates.
+ * @param inY The world space y coordinates.
+ * @param inZ The world space z coordinates.
+ * @param begin The first vertex to project.
+ * @param end One past the last vertex to project.
+ * @param worldToCamera A 4x4 affine matrix that maps points from the world space to the camera space.
+ * @param focalLength The focal length of the camera.
+ * @param canvasWidth The width of the canvas points are projected to in scale relative to values in world space.
+ * @param canvasHeight The height of the canvas points are projected to in scale relative to values in world space.
+ * @param imageWidth The width of the window points are to be drawn on to.
+ * @param imageHeight The height of the window points are to be drawn on to.
+ * @param out Receives the projected vertices at the same indices. It must already hold at least end vertices.
+ */
+void transformVertexRange(const float* inX, const float* inY, const float* inZ, int begin, int end,
+                          const glm::mat4x4& worldToCamera, float focalLength,
+                          float canvasWidth, float canvasHeight,
+                          float imageWidth, float imageHeight,
+                          ProjectedVertices& out)
+{
+    // project2D folded into a single scale and offset per axis.
+    float scaleX = focalLength * imageWidth / canvasWidth;
+    float scaleY = focalLength * imageHeight / canvasHeight;
+    float offsetX = imageWidth / 2.0f;
+    float offsetY = imageHeight / 2.0f;
+    const glm::mat4x4& m = worldToCamera;
+
+    int i = begin;
+
+#if defined(__AVX__)
+    __m256 m00 = _mm256_set1_ps(m[0][0]), m10 = _mm256_set1_ps(m[1][0]), m20 = _mm256_set1_ps(m[2][0]), m30 = _mm256_set1_ps(m[3][0]);
+    __m256 m01 = _mm256_set1_ps(m[0][1]), m11 = _mm256_set1_ps(m[1][1]), m21 = _mm256_set1_ps(m[2][1]), m31 = _mm256_set1_ps(m[3][1]);
+    __m256 m02 = _mm256_set1_ps(m[0][2]), m12 = _mm256_set1_ps(m[1][2]), m22 = _mm256_set1_ps(m[2][2]), m32 = _mm256_set1_ps(m[3][2]);
+    __m256 sx = _mm256_set1_ps(scaleX), sy = _mm256_set1_ps(scaleY);
+    __m256 ox = _mm256_set1_ps(offsetX), oy = _mm256_set1_ps(offsetY);
+    __m256 minusOne = _mm256_set1_ps(-1.0f);
+
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(inX + i);
+        __m256 y = _mm256_loadu_ps(inY + i);
+        __m256 z = _mm256_loadu_ps(inZ + i);
+
+        __m256 camX = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m00, x), _mm256_mul_ps(m10, y)), _mm256_add_ps(_mm256_mul_ps(m20, z), m30));
+        __m256 camY = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m01, x), _mm256_mul_ps(m11, y)), _mm256_add_ps(_mm256_mul_ps(m21, z), m31));
+        __m256 camZ = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m02, x), _mm256_mul_ps(m12, y)), _mm256_add_ps(_mm256_mul_ps(m22, z), m32));
+
+        __m256 invZ = _mm256_div_ps(minusOne, camZ);
+        _mm256_storeu_ps(&out.x[i], _mm256_add_ps(ox, _mm256_mul_ps(_mm256_mul_ps(sx, camX), invZ)));
+        _mm256_storeu_ps(&out.y[i], _mm256_sub_ps(oy, _mm256_mul_ps(_mm256_mul_ps(sy, camY), invZ)));
+        _mm256_storeu_ps(&out.depth[i], invZ);
+    }
+#elif defined(__SSE2__)
+    __m128 m00 = _mm_set1_ps(m[0][0]), m10 = _mm_set1_ps(m[1][0]), m20 = _mm_set1_ps(m[2][0]), m30 = _mm_set1_ps(m[3][0]);
+    __m128 m01 = _mm_set1_ps(m[0][1]), m11 = _mm_set1_ps(m[1][1]), m21 = _mm_set1_ps(m[2][1]), m31 = _mm_set1_ps(m[3][1]);
+    __m128 m02 = _mm_set1_ps(m[0][2]), m12 = _mm_set1_ps(m[1][2]), m22 = _mm_set1_ps(m[2][2]), m32 = _mm_set1_ps(m[3][2]);
+    __m128 sx = _mm_set1_ps(scaleX), sy = _mm_set1_ps(scaleY);
+    __m128 ox = _mm_set1_ps(offsetX), oy = _mm_set1_ps(offsetY);
+    __m128 minusOne = _mm_set1_ps(-1.0f);
+
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(inX + i);
+        __m128 y = _mm_loadu_ps(inY + i);
+        __m128 z = _mm_loadu_ps(inZ + i);
+
+        __m128 camX = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m10, y)), _mm_add_ps(_mm_mul_ps(m20, z), m30));
+        __m128 camY = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m01, x), _mm_mul_ps(m11, y)), _mm_add_ps(_mm_mul_ps(m21, z), m31));
+        __m128 camZ = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m02, x), _mm_mul_ps(m12, y)), _mm_add_ps(_mm_mul_ps(m22, z), m32));
+
+        __m128 invZ = _mm_div_ps(minusOne, camZ);
+        _mm_storeu_ps(&out.x[i], _mm_add_ps(ox, _mm_mul_ps(_mm_mul_ps(sx, camX), invZ)));
+        _mm_storeu_ps(&out.y[i], _mm_sub_ps(oy, _mm_mul_ps(_mm_mul_ps(sy, camY), invZ)));
+        _mm_storeu_ps(&out.depth[i], invZ);
+    }
+#endif
+
+    transformVerticesScalar(inX, inY, inZ, i, end, m, scaleX, scaleY, offsetX, offsetY, out);
+}
+
+/**
+ * Transforms every vertex into camera space and projects it to screen space.
+ *
+ * @param n The number of vertices.
+ * @param arena The arena the projected vertices are allocated from.
+ * @param out Receives the projected vertices, one per input vertex.
+ */
+void transformVertices(const float* inX, const float* inY, const float* inZ, int n,
+                       const glm::mat4x4& worldToCamera, float focalLength,
+                       float canvasWidth, float canvasHeight,
+                       float imageWidth, float imageHeight,
+                       FrameArena& arena, ProjectedVertices& out)
+{
+    out.allocate(arena, n);
+    transformVertexRange(inX, inY, inZ, 0, n, worldToCamera, focalLength, canvasWidth, canvasHeight, imageWidth, imageHeight, out);
+}
+
+void transformVertices(const VertexStream& in, const glm::mat4x4& worldToCamera, float focalLength,
+                       float canvasWidth, float canvasHeight,
+                       float imageWidth, float imageHeight,
+                       FrameArena& arena, ProjectedVertices& out)
+{
+    transformVertices(in.x.data(), in.y.data(), in.z.data(), in.size(), worldToCamera, focalLength,
+                      canvasWidth, canvasHeight, imageWidth, imageHeight, arena, out);
+}
@@ -1,15 +1,36 @@
-#include <ModelTriangle.h>
 #include <CanvasTriangle.h>
 #include <DrawingWindow.h>
 #include <Utils.h>
 #include <glm/glm.hpp>
+#include <chrono>
 #include <fstream>
+#include <iostream>
 #include <vector>
 
+#include "Drawing2D.h"
 #include "Drawing3D.h"
-#include "Image.h"
-#include "Object.h"
+#include "FrameBuffer.h"
+#include "RenderTarget.h"
+#include "FramePresenter.h"
+#include "ThreadPool.h"
+#include "FrameArena.h"
+#include "TiledRenderer.h"
+#include "AdaptiveResolution.h"
+#include "Profiler.h"
+#include "VertexStage.h"
+#include "ImageIO.h"
+#include "Texture.h"
+#include "Mesh.h"
+#include "BVH.h"
+#include "DrawOrder.h"
+#include "SceneGraph.h"
+#include "Clipper.h"
+#include "RayTracer.h"
+#include "ObjParser.h"
+#include "SceneCache.h"
 #include "Camera.h"
+#include "SceneGenerator.h"
+#include "Benchmark.h"
 
 #include "KeyInput.h"
 
@@ -21,25 +42,53 @@ using namespace glm;
 
 #define BLACK 0
 
+// The time a frame may take while the camera moves, in milliseconds.
+#define FRAME_BUDGET 16.0f
 
-void draw();
+
+bool draw(FrameBuffer& output);
 void update();
+void handleInput();
 void handleEvent(SDL_Event event);
 
-std::vector<float> interpolate(float from, float to, float numValues);
-
-DrawingWindow window = DrawingWindow(WIDTH, HEIGHT, false);
-
-std::vector<CanvasTriangle> triangles;
-std::vector<CanvasTriangle> drawList;
-
-Image image = loadPPM("textures/texture.ppm");
+// Each frame is drawn into one buffer while the frame before is presented from the other.
+FrameBuffer frameBufferA(WIDTH, HEIGHT);
+FrameBuffer frameBufferB(WIDTH, HEIGHT);
+FrameBuffer* drawBuffer = &frameBufferA;
+FrameBuffer* presentBuffer = &frameBufferB;
+
+// True while the frame last handed to the presenter has not been shown yet.
+bool frameUnshown = false;
+FrameBuffer lowResFrame(WIDTH, HEIGHT);
+AdaptiveResolution adaptiveResolution(WIDTH, HEIGHT, FRAME_BUDGET);
+ThreadPool threadPool;
+FrameArena frameArena;
+TiledRenderer renderer(threadPool, frameArena, WIDTH, HEIGHT);
+RayTracer rayTracer(threadPool);
+bool rayTracing = false;
+
+#define SCENE_PATH "models/cornell-box.obj"
+#define TEXTURE_PATH "textures/texture.ppm"
+
+SceneCache* sceneCache = NULL;
+Mesh mesh;
+MeshView scene;
+Image image;
+Texture texture;
+BVH sceneBVH;
+
+// Meshes drawn any number of times at their own transforms, on top of the scene.
+SceneGraph sceneGraph;
 
 glm::vec3 cameraPos(0.0f, 0.0f, 8.0f);
 glm::vec3 cameraAngle(0.0f, 0.0f, 0.0f);
 //glm::mat4x4 cameraToWorld = constructCameraSpace(cameraPos, cameraAngle);
 glm::mat4x4 cameraToWorld = lookAt({0, 2, 5}, {0, 0, 0});
 float theta = 0.0f;
+bool orbiting = true;
+
+// Just below the light panel in the ceiling of the Cornell box.
+PointLight light = {glm::vec3(-0.234f, 5.1f, -3.043f), 250.0f};
 
 
 float canvasWidth = WIDTH;
@@ -47,57 +96,487 @@ float canvasHeight = HEIGHT;
 float imageWidth = WIDTH;
 float imageHeight = HEIGHT;
 float focalLength = WIDTH / 2;
+ClipSpace clipSpace = makeClipSpace(focalLength, canvasWidth, canvasHeight, imageWidth, imageHeight);
+FaceCulling faceCulling = CULL_BACK;
+
+ProjectedVertices projected;
+std::vector<uint32_t> visibleNodes;
+std::vector<IndexRange> visibleVertices;
+std::vector<DrawItem> drawOrder;
+std::vector<DrawItem> drawOrderScratch;
+std::vector<DrawItem> instanceOrder;
+
+// Counted whether or not the profiler is built in, so benchmarks can report it.
+uint64_t trianglesSubmitted = 0;
 
-std::vector<Object> objects = loadOBJ("models/cornell-box.obj", 1.0f);
+#if defined(PROFILING)
+bool profileOverlay = false;
+
+// Set by a key press, so the profile is written once the presenter has stopped recording.
+bool profileDumpRequested = false;
+#endif
+
+void loadScene(const char* filepath, const char* texturePath);
+void presentFrame(RenderTarget& target, FramePresenter& presenter, bool drawn);
+int runBenchmarks(int frames, const std::string& mode, const std::string& baselinePath);
+void printArenaUsage();
 
 int main(int argc, char* argv[])
 {
+  loadScene(SCENE_PATH, TEXTURE_PATH);
+  texture = Texture(image);
+  sceneBVH = buildBVH(scene);
+  cout << "Filling spans with " << spanKernels().name << endl;
+
+  // The pure blue material, the tall box in the Cornell box, is a mirror when ray tracing.
+  rayTracer.setScene(scene, &texture);
+  rayTracer.setLight(light, 0.2f);
+  for (int m = 0; m < scene.materialCount; ++m)
+  {
+    if (scene.colours[m] == packRGB(0, 0, 255)) rayTracer.setReflectivity(m, 0.5f);
+  }
+
+  // Usage: graphics --bench [frames] [compare|save] [baseline]
+  // Times scripted camera paths over the Cornell box and generated scenes without opening a window.
+  if (argc > 1 && std::string(argv[1]) == "--bench")
+  {
+    int frames = argc > 2 ? atoi(argv[2]) : 120;
+    std::string mode = argc > 3 ? argv[3] : "compare";
+    std::string baselinePath = argc > 4 ? argv[4] : "bench-baseline.csv";
+    return runBenchmarks(frames, mode, baselinePath);
+  }
+
+  // Usage: graphics --headless [frames] [ppm|raw] [raster|raytrace]
+  // Renders without opening a window, writing every frame to disk.
+  if (argc > 1 && std::string(argv[1]) == "--headless")
+  {
+    int frames = argc > 2 ? atoi(argv[2]) : 1;
+    bool raw = argc > 3 && std::string(argv[3]) == "raw";
+    rayTracing = argc > 4 && std::string(argv[4]) == "raytrace";
+    HeadlessTarget target("frame", raw ? HeadlessTarget::RAW : HeadlessTarget::PPM);
+    FramePresenter presenter(target);
+#if defined(PROFILING)
+    profiler().setTracing(true);
+#endif
+    for (int i = 0; i < frames; ++i)
+    {
+      PROFILE_BEGIN_FRAME();
+      update();
+      bool drawn = draw(*drawBuffer);
+      presentFrame(target, presenter, drawn);
+    }
+    presenter.wait();
+#if defined(PROFILING)
+    profiler().writeCSV("profile.csv");
+    profiler().writeTrace("profile.json");
+#endif
+    printArenaUsage();
+    return 0;
+  }
+
+  adaptiveResolution.setEnabled(true);
+  DrawingWindow window = DrawingWindow(WIDTH, HEIGHT, false);
+  WindowTarget target(window);
+  FramePresenter presenter(target);
   SDL_Event event;
-  initDepthBuffer(WIDTH, HEIGHT);
+#if defined(PROFILING)
+  profiler().setTracing(true);
+#endif
   while(true)
   {
+    PROFILE_BEGIN_FRAME();
     // We MUST poll for events - otherwise the window will freeze !
     if(window.pollForInputEvents(&event)) handleEvent(event);
     update();
-    draw();
-    // Need to render the frame at the end, or nothing actually gets shown on the screen !
-    window.renderFrame();
+    handleInput();
+    bool drawn = draw(*drawBuffer);
+    // Need to present the frame at the end, or nothing actually gets shown on the screen !
+    presentFrame(target, presenter, drawn);
+  }
+}
+
+/**
+ * Shows the frame before last, which the presenter has been busy with
+ * while this one was drawn, then swaps buffers and hands over this frame,
+ * under the profiler's overlay when it is compiled in and switched on.
+ * Frames reach the screen one frame late, but drawing never waits for
+ * presenting unless presenting takes longer.
+ *
+ * When nothing was drawn the screen already holds the last frame once it
+ * has been shown, so nothing is handed over, unless the overlay has a new
+ * frame time to add to it.
+ *
+ * @param target Where frames are shown.
+ * @param presenter The presenter of the frame before.
+ * @param drawn False if nothing was drawn this frame.
+ */
+void presentFrame(RenderTarget& target, FramePresenter& presenter, bool drawn)
+{
+  // With the presenter idle no other thread is recording, so the profiler can close the frame.
+  presenter.wait();
+  PROFILE_END_FRAME();
+#if defined(PROFILING)
+  if (profileDumpRequested)
+  {
+    profiler().writeCSV("profile.csv");
+    profiler().writeTrace("profile.json");
+    profileDumpRequested = false;
+  }
+#endif
+  if (frameUnshown) target.show();
+  frameUnshown = false;
+
+  bool overlay = false;
+#if defined(PROFILING)
+  overlay = profileOverlay;
+#endif
+  if (!drawn && !overlay) return;
+
+  if (drawn) std::swap(drawBuffer, presentBuffer);
+#if defined(PROFILING)
+  if (profileOverlay) profiler().drawOverlay(*presentBuffer);
+#endif
+  presenter.submit(*presentBuffer);
+  frameUnshown = true;
+}
+
+/**
+ * Reports the most memory any frame took from the frame arena.
+ */
+void printArenaUsage()
+{
+  cout << "Frame arena: " << frameArena.peakBytes() / 1024 << " KB peak per frame, "
+       << frameArena.capacity() / 1024 << " KB reserved" << endl;
+}
+
+/**
+ * Times one camera path over a scene.
+ *
+ * @param name The name the case is reported under.
+ * @param view The scene to draw, along with any instances in the scene graph. Ray traced cases always draw the Cornell box the ray tracer was set up with.
+ * @param path The path the camera follows over the timed frames.
+ * @param traced True to ray trace the frames, false to rasterize them.
+ * @param frames The number of frames to time.
+ * @return The timings.
+ */
+BenchmarkResult runBenchmark(const char* name, const MeshView& view, const CameraPath& path, bool traced, int frames)
+{
+  scene = view;
+  sceneBVH = buildBVH(scene);
+  rayTracing = traced;
+
+  BenchmarkResult result;
+  result.name = name;
+  result.triangles = 0.0;
+  result.pixels = 0.0;
+  for (int i = -BENCH_WARMUP_FRAMES; i < frames; ++i)
+  {
+    cameraToWorld = cameraOnPath(path, std::max(i, 0) / (float) frames);
+    uint64_t submitted = trianglesSubmitted;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    draw(*drawBuffer);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (i < 0) continue;
+    result.frameMilliseconds.push_back(ms);
+    result.triangles += trianglesSubmitted - submitted;
+    result.pixels += drawBuffer->coveredPixels();
+  }
+  cout << name << ": " << frames << " frames" << endl;
+  return result;
+}
+
+/**
+ * Runs every benchmark case, prints the results and writes them to bench-results.csv.
+ *
+ * @param frames The number of frames to time in each case.
+ * @param mode "compare" to compare against the baseline, or "save" to make these results the baseline.
+ * @param baselinePath The baseline's CSV file.
+ * @return 1 if comparing found a regression or saving failed, otherwise 0.
+ */
+int runBenchmarks(int frames, const std::string& mode, const std::string& baselinePath)
+{
+  MeshView cornell = scene;
+  BVH cornellBVH = sceneBVH;
+  std::vector<BenchmarkResult> results;
+
+  CameraPath orbit = {CAMERA_ORBIT, glm::vec3(0.0f), 10.0f, 0.0f};
+  CameraPath dolly = {CAMERA_DOLLY, glm::vec3(0.0f, 2.5f, -3.0f), 12.0f, 0.0f};
+  results.push_back(runBenchmark("cornell-orbit", cornell, orbit, false, frames));
+  results.push_back(runBenchmark("cornell-dolly", cornell, dolly, false, frames));
+  results.push_back(runBenchmark("cornell-orbit-raytraced", cornell, orbit, true, frames));
+
+  Mesh generated = generateTriangleSoup(10000, 4.0f, 0.5f, 1);
+  results.push_back(runBenchmark("soup-10k", viewOf(generated), orbit, false, frames));
+
+  generated = generateOverdrawStack(64, 3.0f, 0.05f);
+  CameraPath sway = {CAMERA_SWAY, glm::vec3(0.0f, 0.0f, -1.6f), 9.0f, 0.0f};
+  results.push_back(runBenchmark("overdraw-64", viewOf(generated), sway, false, frames));
+
+  generated = generateTexturedGrid(256, 20.0f, 32.0f, TEXTURE_PATH);
+  CameraPath flyover = {CAMERA_FLYOVER, glm::vec3(0.0f), 16.0f, 3.0f};
+  results.push_back(runBenchmark("textured-grid-131k", viewOf(generated), flyover, false, frames));
+
+  generated = generateSphere(500, 1000, 3.0f);
+  results.push_back(runBenchmark("sphere-1m", viewOf(generated), orbit, false, frames));
+
+  // One small sphere drawn at 1024 transforms, with no scene besides.
+  Mesh empty;
+  Mesh instanced = generateSphere(16, 16, 0.25f);
+  addInstanceGrid(sceneGraph, sceneGraph.addMesh(viewOf(instanced)), 32, 0.5f);
+  results.push_back(runBenchmark("instances-1k", viewOf(empty), flyover, false, frames));
+  sceneGraph = SceneGraph();
+
+  scene = cornell;
+  sceneBVH = cornellBVH;
+  rayTracing = false;
+
+  cout << endl;
+  printResults(results);
+  printArenaUsage();
+  writeResults("bench-results.csv", results);
+
+  if (mode == "save")
+  {
+    if (!writeResults(baselinePath.c_str(), results))
+    {
+      cout << "Could not write the baseline " << baselinePath << endl;
+      return 1;
+    }
+    cout << endl << "Saved the baseline " << baselinePath << endl;
+    return 0;
+  }
+
+  std::vector<BaselineEntry> baseline;
+  if (!readBaseline(baselinePath.c_str(), baseline))
+  {
+    cout << endl << "No baseline at " << baselinePath << "; save one with `make bench-baseline`" << endl;
+    return 0;
   }
+  cout << endl << "Median frame times against " << baselinePath << ":" << endl;
+  int regressions = compareToBaseline(results, baseline);
+  if (regressions > 0) cout << regressions << " case(s) more than " << BENCH_TOLERANCE * 100 << "% slower" << endl;
+  return regressions > 0 ? 1 : 0;
 }
 
-void draw()
+/**
+ * Maps the binary cache of a scene, rebuilding it from the .obj, .mtl and
+ * .ppm sources first if it is missing or out of date.
+ *
+ * @param filepath The location of the .obj file.
+ * @param texturePath The location of the texture's .ppm file.
+ */
+void loadScene(const char* filepath, const char* texturePath)
 {
-  window.clearPixels();
-  clearDepthBuffer();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::string cachePath = std::string(filepath) + ".cache";
+
+  sceneCache = new SceneCache(cachePath.c_str(), 1.0f);
+  if (!sceneCache->isValid())
+  {
+    ParseStats stats;
+    mesh = loadMesh(filepath, 1.0f, &stats, &threadPool);
+    cout << "Loaded " << filepath << ": " << mesh.triangleCount() << " triangles, "
+         << stats.bytes / (1024.0 * 1024.0) << " MB in " << stats.seconds * 1000.0 << " ms ("
+         << stats.megabytesPerSecond() << " MB/s)" << endl;
+    image = loadPPM(texturePath);
+
+    delete sceneCache;
+    sceneCache = NULL;
+    if (writeSceneCache(cachePath.c_str(), mesh, 1.0f, image, texturePath))
+    {
+      sceneCache = new SceneCache(cachePath.c_str(), 1.0f);
+    }
+
+    // Draw from memory if the cache could not be written.
+    if (sceneCache == NULL || !sceneCache->isValid())
+    {
+      scene = viewOf(mesh);
+      return;
+    }
+    mesh = Mesh();
+  }
+
+  scene = sceneCache->mesh();
+  image = sceneCache->texture();
+  cout << "Mapped " << cachePath << ": " << scene.triangleCount << " triangles in "
+       << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000.0 << " ms" << endl;
+}
+
+/**
+ * Assembles a triangle of a mesh from its projected vertices and hands it to the renderer,
+ * unless it faces the culled way, clipping it first if it crosses the near plane or the guard band.
+ *
+ * @param mesh The mesh, the scene or an instanced mesh.
+ * @param vertices The mesh's vertices, projected with modelToCamera.
+ * @param i The index of the triangle.
+ * @param modelToCamera The matrix the vertices were projected with.
+ * @param culling Which faces are thrown away, as seen after modelToCamera.
+ */
+void submitTriangle(const MeshView& mesh, const ProjectedVertices& vertices, uint32_t i, const glm::mat4x4& modelToCamera, FaceCulling culling)
+{
+  PROFILE_COUNT(COUNT_TRIANGLES_SUBMITTED, 1);
+  ++trianglesSubmitted;
+  const uint32_t* corners = mesh.indices + 3*i;
+  CanvasPoint v[3];
+  bool unclipped = true;
+  for (int k = 0; k < 3; ++k)
+  {
+    uint32_t vertex = corners[k];
+    v[k] = CanvasPoint(vertices.x[vertex], vertices.y[vertex], vertices.depth[vertex]);
+    unclipped = unclipped && isUnclipped(clipSpace, v[k].x, v[k].y, v[k].depth);
+  }
+  if (unclipped && isCulled(culling, v[0], v[1], v[2]))
+  {
+    PROFILE_COUNT(COUNT_TRIANGLES_CULLED, 1);
+    return;
+  }
+
+  // Textured materials all sample the scene texture. OBJ texture coordinates start at the bottom of the image.
+  uint32_t material = mesh.materialIds[i];
+  bool textured = false;
+  if (mesh.texCoordIndices != NULL && (mesh.materialFlags[material] & MATERIAL_TEXTURED))
+  {
+    const uint32_t* t = mesh.texCoordIndices + 3*i;
+    textured = t[0] != NO_INDEX && t[1] != NO_INDEX && t[2] != NO_INDEX;
+    for (int k = 0; k < 3 && textured; ++k) v[k].texturePoint = TexturePoint(mesh.u[t[k]], 1.0f - mesh.v[t[k]]);
+  }
+
+  int count = 3;
+  CanvasPoint clipped[MAX_CLIP_VERTICES];
+  const CanvasPoint* polygon = v;
+  if (!unclipped)
+  {
+    ClipVertex triangle[3];
+    for (int k = 0; k < 3; ++k)
+    {
+      uint32_t vertex = corners[k];
+      glm::vec4 camera = modelToCamera * glm::vec4(mesh.x[vertex], mesh.y[vertex], mesh.z[vertex], 1.0f);
+      triangle[k].position = glm::vec3(camera.x, camera.y, camera.z);
+      triangle[k].u = v[k].texturePoint.x;
+      triangle[k].v = v[k].texturePoint.y;
+    }
+    count = isCulled(culling, triangle) ? 0 : clipTriangle(clipSpace, triangle, clipped);
+    if (count == 0)
+    {
+      PROFILE_COUNT(COUNT_TRIANGLES_CULLED, 1);
+      return;
+    }
+    polygon = clipped;
+  }
+
+  for (int k = 1; k + 1 < count; ++k)
+  {
+    if (textured) renderer.submit(polygon[0], polygon[k], polygon[k + 1], texture, TEXTURE_TRILINEAR, TEXTURE_WRAP);
+    else renderer.submit(polygon[0], polygon[k], polygon[k + 1], mesh.colours[material]);
+  }
+}
+
+/**
+ * Rasterizes the scene.
+ *
+ * @param frame The frame buffer to draw into. Its size is the image size.
+ */
+void rasterizeScene(FrameBuffer& frame)
+{
+  imageWidth = frame.width;
+  imageHeight = frame.height;
+  clipSpace = makeClipSpace(focalLength, canvasWidth, canvasHeight, imageWidth, imageHeight);
+  renderer.resize(frame.width, frame.height);
 
   glm::mat4x4 worldToCamera = glm::inverse(cameraToWorld);
 
-  for (Object obj : objects)
+  // Cull the BVH and the instances against the view frustum, then project each vertex the visible triangles use once.
+  Frustum frustum = frustumFromCamera(worldToCamera, focalLength, canvasWidth, canvasHeight);
+  {
+    PROFILE_SCOPE(STAGE_CLIP_CULL);
+    cullBVH(sceneBVH, frustum, visibleNodes);
+    vertexRangesOf(sceneBVH, visibleNodes, visibleVertices);
+    sceneGraph.update();
+    sceneGraph.sortVisibleInstances(frustum, worldToCamera, instanceOrder, drawOrderScratch);
+  }
+
   {
-    for (ModelTriangle m : obj.triangles)
+    PROFILE_SCOPE(STAGE_TRANSFORM);
+    projected.allocate(frameArena, scene.vertexCount);
+    for (const IndexRange& range : visibleVertices)
     {
-      CanvasTriangle t = projectTriangle(m, worldToCamera, focalLength, canvasWidth, canvasHeight, imageWidth, imageHeight);
-      fillTriangle(t, window);
+      transformVertexRange(scene.x, scene.y, scene.z, range.begin, range.end, worldToCamera, focalLength, canvasWidth, canvasHeight, imageWidth, imageHeight, projected);
     }
   }
 
-  for (CanvasTriangle t : drawList)
+  // Submit the visible leaves front to back, so nearer triangles fill the depth buffer first.
   {
-    //fillTriangle(t);
-    uint32 rgb = packRGB(t.colour.red, t.colour.green, t.colour.blue);
-    drawTriangle(t, rgb, window);
+    PROFILE_SCOPE(STAGE_CLIP_CULL);
+    sortFrontToBack(sceneBVH, visibleNodes, worldToCamera, drawOrder, drawOrderScratch);
+    for (const DrawItem& item : drawOrder)
+    {
+      const BVHNode& n = sceneBVH.nodes[item.node];
+      for (uint32_t k = n.firstTriangle; k < n.firstTriangle + n.triangleCount; ++k) submitTriangle(scene, projected, sceneBVH.triangles[k], worldToCamera, faceCulling);
+    }
   }
+
+  // Each visible instance, nearest first, is projected straight from its shared mesh into one reused buffer.
+  ProjectedVertices instanceVertices;
+  if (!instanceOrder.empty()) instanceVertices.allocate(frameArena, sceneGraph.largestMeshVertices());
+  for (const DrawItem& item : instanceOrder)
+  {
+    const MeshView& instance = sceneGraph.mesh(sceneGraph.meshOf(item.node));
+    glm::mat4x4 modelToCamera = worldToCamera * sceneGraph.world(item.node);
+    {
+      PROFILE_SCOPE(STAGE_TRANSFORM);
+      transformVertexRange(instance.x, instance.y, instance.z, 0, instance.vertexCount, modelToCamera, focalLength, canvasWidth, canvasHeight, imageWidth, imageHeight, instanceVertices);
+    }
+
+    // A mirrored instance's triangles wind the other way on screen, so its front faces are kept by culling the other side.
+    PROFILE_SCOPE(STAGE_CLIP_CULL);
+    FaceCulling culling = sceneGraph.isMirrored(item.node) ? mirrorCulling(faceCulling) : faceCulling;
+    for (int k = 0; k < instance.triangleCount; ++k) submitTriangle(instance, instanceVertices, k, modelToCamera, culling);
+  }
+
+  renderer.flush(frame, BLACK);
+}
+
+/**
+ * Draws the scene, unless the frame already on screen is final.
+ *
+ * @param output The frame buffer to draw into, at full size.
+ * @return False if nothing was drawn.
+ */
+bool draw(FrameBuffer& output)
+{
+  // While the camera moves the scene may be drawn smaller and scaled up, to keep to the frame budget.
+  if (sceneGraph.isDirty()) adaptiveResolution.invalidate();
+  int scale = adaptiveResolution.begin(cameraToWorld, focalLength);
+  if (scale == 0) return false;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  FrameBuffer& frame = scale == 1 ? output : lowResFrame;
+  frame.resize((WIDTH + scale - 1) / scale, (HEIGHT + scale - 1) / scale);
+  if (rayTracing) rayTracer.render(frame, BLACK, cameraToWorld, focalLength, canvasWidth, canvasHeight);
+  else rasterizeScene(frame);
+  PROFILE_COUNT(COUNT_PIXELS_COVERED, frame.coveredPixels());
+  if (scale > 1) upscale(lowResFrame, output, threadPool, frameArena);
+
+  adaptiveResolution.end(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+  // Everything allocated for this frame is done with.
+  frameArena.reset();
+  return true;
 }
 
 void update()
 {
-  float vel = 0.02f;
-  glm::vec3 translation = {0, 0, 0};
   // Function for performing animation (shifting artifacts or moving the camera)
-  updateKeyboard();
-
+  if (!orbiting) return;
   cameraToWorld = rotateAbout({0, 0, 0}, 10, theta);
   theta += 0.1f;
+}
+
+void handleInput()
+{
+  float vel = 0.02f;
+  glm::vec3 translation = {0, 0, 0};
+  updateKeyboard();
 
   if(keyDown(SDL_SCANCODE_LEFT)) translation.x -= vel;
   if(keyDown(SDL_SCANCODE_RIGHT)) translation.x += vel;
@@ -123,8 +602,6 @@ void update()
   if(keyDown(SDL_SCANCODE_I)) focalLength -= 10;
 
   translate(cameraToWorld, translation);
-
-
 }
 
 void handleEvent(SDL_Event event)
@@ -132,6 +609,24 @@ void handleEvent(SDL_Event event)
 
 
   if(event.type == SDL_KEYDOWN) {
+    // Cycle through no culling, back face culling and front face culling
+    if(event.key.keysym.scancode == SDL_SCANCODE_B) faceCulling = FaceCulling((faceCulling + 1) % 3);
+    // Toggle the depth pre-pass
+    if(event.key.keysym.scancode == SDL_SCANCODE_P) renderer.setDepthPrePass(!renderer.hasDepthPrePass());
+    // Switch between rasterizing and ray tracing
+    if(event.key.keysym.scancode == SDL_SCANCODE_R) rayTracing = !rayTracing;
+    // Pause or resume the camera's orbit
+    if(event.key.keysym.scancode == SDL_SCANCODE_SPACE) orbiting = !orbiting;
+    // Toggle adaptive resolution
+    if(event.key.keysym.scancode == SDL_SCANCODE_V) adaptiveResolution.setEnabled(!adaptiveResolution.isEnabled());
+#if defined(PROFILING)
+    // Toggle the profiler's frame time graph
+    if(event.key.keysym.scancode == SDL_SCANCODE_G) profileOverlay = !profileOverlay;
+    // Write the profiler's history and trace events to profile.csv and profile.json at the end of the frame
+    if(event.key.keysym.scancode == SDL_SCANCODE_C) profileDumpRequested = true;
+#endif
+    adaptiveResolution.invalidate();
+
     // Position
     std::cout << cameraPos.x << ", " << cameraPos.y << ", " << cameraPos.z <<std::endl;
     std::cout << cameraAngle.x << ", " << cameraAngle.y << ", " << cameraAngle.z << std::endl << std::endl;
@@ -0,0 +1,131 @@
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "../src/ImageIO.h"
+
+// Checks Netpbm headers are parsed and checked against the payload that
+// follows them: well formed files of each format load with the right
+// pixels, and bad headers, oversized images and truncated payloads are
+// rejected without touching the image they would have been loaded into.
+
+#define IMAGE_FILE "image-io-test.pnm"
+
+int failures = 0;
+
+void check(bool passed, const char* what)
+{
+  if (passed) return;
+  printf("FAILED: %s\n", what);
+  ++failures;
+}
+
+/**
+ * @return A literal's bytes, embedded zeros and all, without its terminator.
+ */
+template <size_t N>
+std::string bytes(const char (&literal)[N])
+{
+  return std::string(literal, N - 1);
+}
+
+bool parseHeader(const std::string& file, PNMHeader& header)
+{
+  return readPNMHeader(file.data(), file.data() + file.size(), header);
+}
+
+/**
+ * Writes a file and loads it, keeping the loader's complaints quiet.
+ *
+ * @param contents The whole file.
+ * @param image Receives the image.
+ * @return Whether it loaded.
+ */
+bool load(const std::string& contents, Image& image)
+{
+  FILE* file = fopen(IMAGE_FILE, "wb");
+  if (file == NULL) return false;
+  fwrite(contents.data(), 1, contents.size(), file);
+  fclose(file);
+
+  std::ostringstream ignored;
+  std::streambuf* cerr = std::cerr.rdbuf(ignored.rdbuf());
+  bool loaded = loadImage(IMAGE_FILE, image);
+  std::cerr.rdbuf(cerr);
+  remove(IMAGE_FILE);
+  return loaded;
+}
+
+/**
+ * @return True if the file is rejected and the image it was loaded into is left empty.
+ */
+bool rejects(const std::string& contents)
+{
+  Image image;
+  return !load(contents, image) && image.getWidth() == 0 && image.getPayload() == NULL;
+}
+
+void testHeaders()
+{
+  PNMHeader header;
+  check(parseHeader("P6\n# a comment\n3 2\n255\nxxxxxxxxxxxxxxxxxx", header) && header.format == '6' &&
+        header.width == 3 && header.height == 2 && header.channels == 3 && header.maxval == 255 && header.dataOffset == 23,
+        "P6 headers, with comments");
+  check(parseHeader("P5 4 4 65535\n", header) && header.channels == 1 && header.maxval == 65535, "P5 headers");
+
+  check(parseHeader("P7\nWIDTH 2\nHEIGHT 3\nDEPTH 4\nMAXVAL 65535\nTUPLTYPE RGB_ALPHA\nENDHDR\n", header) &&
+        header.width == 2 && header.height == 3 && header.channels == 4 && header.maxval == 65535,
+        "PAM headers, in any order, skipping TUPLTYPE");
+  check(parseHeader("P7\nMAXVAL 255\nDEPTH 2\nHEIGHT 1\nWIDTH 1\nENDHDR\n", header) && header.channels == 2 && header.maxval == 255,
+        "PAM fields in another order");
+  check(!parseHeader("P7\nWIDTH 2\nHEIGHT 2\nDEPTH 5\nMAXVAL 255\nENDHDR\n", header), "PAM DEPTH above 4 is rejected");
+  check(!parseHeader("P7\nWIDTH 2\nHEIGHT 2\nDEPTH 0\nMAXVAL 255\nENDHDR\n", header), "PAM DEPTH 0 is rejected");
+  check(!parseHeader("P7\nWIDTH 2\nHEIGHT 2\nDEPTH 3\nENDHDR\n", header), "PAM without MAXVAL is rejected");
+  check(!parseHeader("P7\nWIDTH 2\nHEIGHT 2\nDEPTH 3\nMAXVAL 65536\nENDHDR\n", header), "PAM MAXVAL above 65535 is rejected");
+  check(!parseHeader("P7\nWIDTH 2\nHEIGHT 2\nDEPTH 3\nMAXVAL 255\n", header), "PAM without ENDHDR is rejected");
+
+  check(!parseHeader("P6 2 2 0\n", header), "maxval 0 is rejected");
+  check(!parseHeader("P6 0 2 255\n", header), "zero width is rejected");
+  check(!parseHeader("P6 99999999999 2 255\n", header), "widths past INT_MAX are rejected");
+  check(!parseHeader("P6 -2 2 255\n", header), "negative widths are rejected");
+  check(!parseHeader("P6 2 2 255", header), "a binary header without the whitespace before its samples is rejected");
+  check(!parseHeader("P4 2 2\n", header), "unsupported formats are rejected");
+  check(!parseHeader("P", header), "files too short to have a format are rejected");
+}
+
+void testPayloads()
+{
+  Image image;
+  check(load(bytes("P6 2 1 255\n\xFF\x00\x00\x00\x80\xFF"), image) && image.getWidth() == 2 &&
+        image.getPayload()[0] == 0xFFFF0000u && image.getPayload()[1] == 0xFF0080FFu, "8-bit P6 loads");
+  check(load("P3 2 1 255\n255 0 0\n0 128 255\n", image) && image.getPayload()[1] == 0xFF0080FFu, "P3 loads");
+  check(load(bytes("P7\nWIDTH 1\nHEIGHT 1\nDEPTH 2\nMAXVAL 255\nENDHDR\n\x40\x80"), image) &&
+        image.getPayload()[0] == 0x80404040u, "grey and alpha PAM loads");
+  check(load(bytes("P7\nWIDTH 1\nHEIGHT 1\nDEPTH 4\nMAXVAL 65535\nENDHDR\n\xFF\xFF\x00\x00\x80\x00\xFF\xFF"), image) &&
+        image.getPayload()[0] == 0xFFFF0080u, "16-bit RGB and alpha PAM loads");
+
+  // A byte short of the samples the header promises.
+  check(rejects(bytes("P6 2 1 255\n\xFF\x00\x00\x00\x80")), "truncated 8-bit P6 is rejected");
+  check(rejects(bytes("P5 2 1 65535\n\xFF\xFF\x00")), "16-bit P5 with 8-bit samples is rejected");
+  check(rejects(bytes("P7\nWIDTH 1\nHEIGHT 1\nDEPTH 4\nMAXVAL 255\nENDHDR\n\x01\x02\x03")), "truncated PAM is rejected");
+
+  // Too short to hold the samples at all, and long enough but a sample short.
+  check(rejects("P3 2 1 255\n255 0 0\n"), "truncated P3 is rejected");
+  check(rejects("P3 2 1 255\n255 0 0   0 128    "), "P3 with separators in place of samples is rejected");
+
+  // Far bigger than the payload: rejected from the header, before anything is allocated.
+  check(rejects("P6 20000 20000 255\n\x01\x02\x03"), "images over IMAGE_MAX_PIXELS are rejected");
+  check(rejects("P6 16384 16384 255\n\x01\x02\x03"), "images at IMAGE_MAX_PIXELS with a tiny payload are rejected");
+  check(rejects("P3 16384 16384 255\n1 2 3\n"), "ASCII images with a tiny payload are rejected");
+  check(rejects("P7\nWIDTH 65536\nHEIGHT 65536\nDEPTH 4\nMAXVAL 65535\nENDHDR\n"), "PAM over IMAGE_MAX_PIXELS is rejected");
+}
+
+int main()
+{
+  testHeaders();
+  testPayloads();
+
+  if (failures > 0) return 1;
+  printf("Image IO tests passed\n");
+  return 0;
+}
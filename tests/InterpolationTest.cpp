@@ -0,0 +1,83 @@
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "../src/Drawing2D.h"
+#include "../src/Interpolation.h"
+
+// Checks the SIMD interpolation paths against their scalar paths, and
+// fillTriangle2D, the interpolators' caller, against a known triangle.
+
+int failures = 0;
+
+void check(bool passed, const char* what, int numValues)
+{
+  if (passed) return;
+  printf("FAILED: %s with %d values\n", what, numValues);
+  ++failures;
+}
+
+void testInterpolate(float from, float to, int numValues)
+{
+  std::vector<float> simd(numValues), scalar(numValues);
+  interpolate(from, to, numValues, simd.data());
+  interpolateScalar(from, interpolationStep(from, to, numValues), 0, numValues, scalar.data());
+
+  bool same = true;
+  for (int i = 0; i < numValues; ++i) same = same && std::abs(simd[i] - scalar[i]) <= 1e-5f * std::max(1.0f, std::abs(scalar[i]));
+  check(same, "interpolate matches interpolateScalar", numValues);
+  if (numValues > 0) check(simd[0] == from, "interpolate starts at from", numValues);
+  if (numValues > 1) check(std::abs(simd[numValues - 1] - to) <= 1e-4f * std::max(1.0f, std::abs(to)), "interpolate ends at to", numValues);
+}
+
+void testInterpolateFixed(float from, float to, int numValues)
+{
+  std::vector<int32_t> simd(numValues), scalar(numValues);
+  interpolateFixed(from, to, numValues, simd.data());
+  int32_t start = (int32_t) std::lround(from * INTERPOLATION_FIXED_ONE);
+  int32_t step = (int32_t) std::lround(interpolationStep(from, to, numValues) * INTERPOLATION_FIXED_ONE);
+  interpolateFixedScalar(start, step, 0, numValues, scalar.data());
+  check(simd == scalar, "interpolateFixed matches interpolateFixedScalar", numValues);
+
+  // The streaming interpolators step through the same values.
+  FixedInterpolator fixed(from, to, numValues);
+  Interpolator<float> floating(from, to, numValues);
+  bool same = true;
+  std::vector<float> expected(numValues);
+  interpolate(from, to, numValues, expected.data());
+  for (int i = 0; i < numValues; ++i, ++fixed, ++floating)
+  {
+    same = same && !fixed.done() && !floating.done() && fixed.fixed() == scalar[i];
+    same = same && std::abs(*floating - expected[i]) <= 1e-3f * std::max(1.0f, std::abs(expected[i]));
+  }
+  check(same && fixed.done() && floating.done(), "the interpolators step through every value", numValues);
+}
+
+void testFillTriangle()
+{
+  FrameBuffer frame(64, 64);
+  uint32_t red = packRGB(255, 0, 0);
+  CanvasTriangle triangle(CanvasPoint(4, 4), CanvasPoint(60, 20), CanvasPoint(20, 60), Colour(255, 0, 0));
+  fillTriangle2D(triangle, frame);
+
+  check(frame.getPixel(25, 25) == red, "fillTriangle2D fills the inside", 0);
+  check(frame.getPixel(50, 50) != red && frame.getPixel(2, 30) != red, "fillTriangle2D leaves the outside", 0);
+}
+
+int main()
+{
+  // Lengths either side of the SIMD width exercise the batch, the tail, and both together.
+  int lengths[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 16, 17, 100, 1001};
+  for (int numValues : lengths)
+  {
+    testInterpolate(0.0f, 1.0f, numValues);
+    testInterpolate(-37.5f, 512.25f, numValues);
+    testInterpolate(720.0f, 0.0f, numValues);
+    testInterpolateFixed(0.0f, 719.0f, numValues);
+    testInterpolateFixed(300.5f, -20.25f, numValues);
+  }
+  testFillTriangle();
+
+  if (failures > 0) return 1;
+  printf("Interpolation tests passed\n");
+  return 0;
+}
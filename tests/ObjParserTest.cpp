@@ -0,0 +1,139 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../src/ObjParser.h"
+
+// Loads a synthetic .obj several megabytes long on one thread and on a
+// pool, so it is split into chunks, and checks both give the same mesh.
+// The file has negative indices, texture coordinates that come after the
+// faces using them, and materials that stay in effect over many chunk
+// boundaries.
+
+#define OBJ_FILE "obj-parser-test.obj"
+#define MTL_FILE "obj-parser-test.mtl"
+
+// Each block is a quad and a triangle, about 250 bytes, so the file spans several 1 MB chunks.
+#define BLOCKS 24000
+
+int failures = 0;
+
+void check(bool passed, const char* what)
+{
+  if (passed) return;
+  printf("FAILED: %s\n", what);
+  ++failures;
+}
+
+/**
+ * Writes the test's .obj and .mtl files.
+ *
+ * @return False if either could not be written.
+ */
+bool writeFiles()
+{
+  FILE* mtl = fopen(MTL_FILE, "w");
+  if (mtl == NULL) return false;
+  fprintf(mtl, "newmtl Red\nKd 1 0 0\n\nnewmtl Green\nKd 0 1 0\n\nnewmtl Blue\nKd 0 0 1\n");
+  if (fclose(mtl) != 0) return false;
+
+  FILE* obj = fopen(OBJ_FILE, "w");
+  if (obj == NULL) return false;
+  fprintf(obj, "# Generated by ObjParserTest\nmtllib " MTL_FILE "\n");
+
+  // Faces before the first usemtl take the default material.
+  const char* materials[] = {"Red", "Green", "Blue", "Missing"};
+  for (int b = 0; b < BLOCKS; ++b)
+  {
+    if (b % 1000 == 0) fprintf(obj, "o part%d\n", b / 1000);
+    if (b % 5000 == 4999) fprintf(obj, "usemtl %s\n", materials[(b / 5000) % 4]);
+
+    for (int i = 0; i < 4; ++i) fprintf(obj, "v %d.%03d %d.5 -%d.25\n", b, i * 250, i, b % 7);
+    fprintf(obj, "vn 0 %d 1\n", b % 2);
+
+    // Odd blocks write their texture coordinates after their faces, so those faces'
+    // relative indices reach back to the block before, and their absolute ones forward.
+    bool late = b % 2 == 1;
+    if (!late) fprintf(obj, "vt 0.%d 0.5\nvt 0.25 0.%d\n", b % 10, (b + 3) % 10);
+    fprintf(obj, "f -4/-2/-1 -3/-1/-1 -2/%d -1//-1\n", 2 * b + 1);
+    fprintf(obj, "  f -4 -2/-1 -1/-2/-1 # a comment\n");
+    if (late) fprintf(obj, "vt 0.%d 0.5\nvt 0.25 0.%d\n", b % 10, (b + 3) % 10);
+  }
+  return fclose(obj) == 0;
+}
+
+bool sameBounds(const AABB& a, const AABB& b)
+{
+  for (int i = 0; i < 3; ++i)
+  {
+    if (a.min[i] != b.min[i] || a.max[i] != b.max[i]) return false;
+  }
+  return true;
+}
+
+void testSerialMatchesParallel()
+{
+  ThreadPool pool(4);
+  ParseStats stats;
+  Mesh serial = loadMesh(OBJ_FILE, 0.5f);
+  Mesh parallel = loadMesh(OBJ_FILE, 0.5f, &stats, &pool);
+  check(stats.bytes > 4 << 20, "the file is long enough to be split into chunks");
+
+  check(serial.positions.x == parallel.positions.x && serial.positions.y == parallel.positions.y &&
+        serial.positions.z == parallel.positions.z, "positions match");
+  check(serial.texCoords.u == parallel.texCoords.u && serial.texCoords.v == parallel.texCoords.v, "texture coordinates match");
+  check(serial.normals.x == parallel.normals.x && serial.normals.y == parallel.normals.y &&
+        serial.normals.z == parallel.normals.z, "normals match");
+  check(serial.indices == parallel.indices, "position indices match");
+  check(serial.texCoordIndices == parallel.texCoordIndices, "texture coordinate indices match");
+  check(serial.normalIndices == parallel.normalIndices, "normal indices match");
+  check(serial.materialIds == parallel.materialIds, "materials match");
+  check(serial.materials.names == parallel.materials.names && serial.materials.colours == parallel.materials.colours,
+        "material tables match");
+  check(serial.objectStarts == parallel.objectStarts, "object starts match");
+
+  bool sameObjects = serial.objects.size() == parallel.objects.size();
+  for (size_t i = 0; sameObjects && i < serial.objects.size(); ++i)
+  {
+    const MeshObject& a = serial.objects[i];
+    const MeshObject& b = parallel.objects[i];
+    sameObjects = a.name == b.name && a.firstTriangle == b.firstTriangle && a.triangleCount == b.triangleCount &&
+                  a.firstVertex == b.firstVertex && a.vertexCount == b.vertexCount &&
+                  sameBounds(a.bounds, b.bounds);
+  }
+  check(sameObjects, "objects match");
+
+  // Spot checks that the file was read as intended, so a mesh that is wrong the same way twice still fails.
+  check(serial.positions.size() == 4 * BLOCKS && serial.texCoords.size() == 2 * BLOCKS && serial.normals.size() == BLOCKS,
+        "every vertex record is read");
+  check(serial.triangleCount() == 3 * BLOCKS, "quads are fanned into two triangles");
+  check(serial.objects.size() == BLOCKS / 1000, "every object is read");
+
+  // Block 1 is late: its relative texture coordinates are block 0's, and its absolute one is not defined yet, so it is dropped.
+  check(serial.indices[9] == 4 && serial.indices[10] == 5 && serial.indices[11] == 6, "negative indices resolve");
+  check(serial.texCoordIndices[9] == 0 && serial.texCoordIndices[10] == 1 && serial.texCoordIndices[11] == NO_INDEX,
+        "late texture coordinates");
+  check(serial.texCoordIndices[0] == 0 && serial.normalIndices[0] == 0, "texture coordinates and normals before the faces");
+
+  // Red from block 4999, Green from 9999, Blue from 14999, then an unknown material, which falls back to the default.
+  int red = serial.materials.find("Red");
+  int blue = serial.materials.find("Blue");
+  check(serial.materialIds[0] == 0, "faces before any usemtl take the default material");
+  check((int) serial.materialIds[3 * 5000] == red && (int) serial.materialIds[3 * 9998 + 2] == red, "usemtl lasts until the next");
+  check((int) serial.materialIds[3 * 15000] == blue && serial.materialIds[3 * 20000] == 0, "unknown materials take the default");
+}
+
+int main()
+{
+  if (!writeFiles())
+  {
+    printf("FAILED: could not write " OBJ_FILE "\n");
+    return 1;
+  }
+  testSerialMatchesParallel();
+  remove(OBJ_FILE);
+  remove(MTL_FILE);
+
+  if (failures > 0) return 1;
+  printf("OBJ parser tests passed\n");
+  return 0;
+}
@@ -0,0 +1,83 @@
+#define PROFILING
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "../src/Profiler.h"
+
+// Records from more threads than the profiler has slots, so the threads
+// past the last slot all share it, and checks nothing recorded is lost.
+// Build it with -fsanitize=thread as well to check the shared slot is
+// locked.
+
+#define THREADS 200
+#define RECORDS 1000
+#define TRACE_FILE "profiler-test.json"
+
+int failures = 0;
+
+void check(bool passed, const char* what)
+{
+  if (passed) return;
+  printf("FAILED: %s\n", what);
+  ++failures;
+}
+
+/**
+ * @return The number of trace events in a file written by writeTrace, or -1 if it could not be read.
+ */
+int countTraceEvents(const char* fileName)
+{
+  FILE* file = fopen(fileName, "r");
+  if (file == NULL) return -1;
+
+  int events = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), file) != NULL)
+  {
+    if (strstr(line, "\"ph\":\"X\"") != NULL) ++events;
+  }
+  fclose(file);
+  return events;
+}
+
+int main()
+{
+  profiler().setTracing(true);
+  PROFILE_BEGIN_FRAME();
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < THREADS; ++i)
+  {
+    threads.push_back(std::thread([] {
+      for (int k = 0; k < RECORDS; ++k)
+      {
+        PROFILE_SCOPE(STAGE_RASTER);
+        PROFILE_COUNT(COUNT_PIXELS_TESTED, 1);
+      }
+    }));
+  }
+  for (std::thread& thread : threads) thread.join();
+  PROFILE_END_FRAME();
+
+  const FrameProfile& frame = profiler().frame(0);
+  check(frame.counters[COUNT_PIXELS_TESTED] == (uint64_t) THREADS * RECORDS, "every count is summed into the frame");
+  check(frame.stageMilliseconds[STAGE_RASTER] > 0.0, "the stage time is summed into the frame");
+
+  // Each slot keeps up to its share of PROFILE_MAX_EVENTS, and the shared slot holds every thread past the others.
+  int perSlot = PROFILE_MAX_EVENTS / PROFILE_MAX_THREADS;
+  int sharing = THREADS - PROFILE_SHARED_SLOT;
+  int expected = PROFILE_SHARED_SLOT * std::min(RECORDS, perSlot) + std::min(sharing * RECORDS, perSlot);
+  check(profiler().writeTrace(TRACE_FILE), "the trace is written");
+  check(countTraceEvents(TRACE_FILE) == expected, "every slot's events are traced, up to its share");
+
+  // Writing the trace forgets the events written.
+  check(profiler().writeTrace(TRACE_FILE), "the trace is written again");
+  check(countTraceEvents(TRACE_FILE) == 0, "written events are forgotten");
+  remove(TRACE_FILE);
+
+  if (failures > 0) return 1;
+  printf("Profiler tests passed\n");
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "../src/ImageIO.h"
+#include "../src/ObjParser.h"
+#include "../src/SceneCache.h"
+
+// Writes a scene cache and edits its source in ways that keep the size,
+// and at times the modification time, the same, checking the cache is
+// rejected every time the contents change and kept when they do not.
+
+#define OBJ_FILE "scene-cache-test.obj"
+#define TEXTURE_FILE "scene-cache-test.ppm"
+#define CACHE_FILE "scene-cache-test.cache"
+
+// Two scenes of the same size.
+#define SCENE "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n"
+#define EDITED_SCENE "v 0 0 0\nv 2 0 0\nv 0 1 0\nf 1 2 3\n"
+
+int failures = 0;
+
+void check(bool passed, const char* what)
+{
+  if (passed) return;
+  printf("FAILED: %s\n", what);
+  ++failures;
+}
+
+bool writeFile(const char* fileName, const char* contents)
+{
+  FILE* file = fopen(fileName, "wb");
+  if (file == NULL) return false;
+  bool ok = fputs(contents, file) >= 0;
+  return fclose(file) == 0 && ok;
+}
+
+/**
+ * Loads the scene from its sources and caches it.
+ */
+bool writeCache()
+{
+  Mesh mesh = loadMesh(OBJ_FILE, 1.0f);
+  Image texture = loadPPM(TEXTURE_FILE);
+  return mesh.triangleCount() == 1 && writeSceneCache(CACHE_FILE, mesh, 1.0f, texture, TEXTURE_FILE);
+}
+
+bool cacheValid()
+{
+  SceneCache cache(CACHE_FILE, 1.0f);
+  return cache.isValid();
+}
+
+/**
+ * Sets a file's modification time, as touch -r does. Its change time moves on regardless.
+ */
+bool setModificationTime(const char* fileName, const struct stat& from)
+{
+  struct timespec times[2];
+  times[0].tv_sec = from.st_atime;
+  times[0].tv_nsec = UTIME_OMIT;
+  times[1].tv_sec = from.st_mtime;
+  times[1].tv_nsec = modificationNanoseconds(from);
+  return utimensat(AT_FDCWD, fileName, times, 0) == 0;
+}
+
+void testSameSecondEdit()
+{
+  // The cache is stamped in the same second the source was written, so the
+  // edit straight after may leave its times as they were. It must be hashed.
+  check(writeFile(OBJ_FILE, SCENE) && writeCache(), "the cache is written");
+  check(cacheValid(), "a cache stamped in the second its source was written is used");
+  check(writeFile(OBJ_FILE, EDITED_SCENE), "the source is edited");
+  check(!cacheValid(), "a same size edit in the second the cache was stamped is caught");
+}
+
+void testRestoredModificationTime()
+{
+  // Stamped a second after the source last changed, so matching times are trusted.
+  check(writeFile(OBJ_FILE, SCENE), "the source is written");
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  check(writeCache(), "the cache is written");
+  check(cacheValid(), "a cache stamped after its source last changed is used");
+
+  // Touching the source without changing it moves its times, but its hash still matches.
+  struct stat original;
+  check(stat(OBJ_FILE, &original) == 0, "the source is stat'ed");
+  struct timespec now[2] = {{0, UTIME_NOW}, {0, UTIME_NOW}};
+  check(utimensat(AT_FDCWD, OBJ_FILE, now, 0) == 0 && cacheValid(), "a cache whose source was only touched is used");
+
+  // A same size edit with the modification time put back leaves only the change time to go on.
+  check(writeFile(OBJ_FILE, EDITED_SCENE) && setModificationTime(OBJ_FILE, original), "the source is edited and its time restored");
+  struct stat edited;
+  check(stat(OBJ_FILE, &edited) == 0 && edited.st_mtime == original.st_mtime &&
+        modificationNanoseconds(edited) == modificationNanoseconds(original), "the modification time is restored");
+  check(!cacheValid(), "a same size edit with the modification time restored is caught");
+}
+
+int main()
+{
+  Image texture(2, 2);
+  for (int i = 0; i < 4; ++i) texture.getPayload()[i] = 0xFF000000u | (uint32_t) i;
+  check(savePPM(TEXTURE_FILE, texture), "the texture is written");
+
+  testSameSecondEdit();
+  testRestoredModificationTime();
+
+  remove(OBJ_FILE);
+  remove(TEXTURE_FILE);
+  remove(CACHE_FILE);
+
+  if (failures > 0) return 1;
+  printf("Scene cache tests passed\n");
+  return 0;
+}